@@ -49,6 +49,9 @@ Q_DECL_EXPORT int main(int argc, char *argv[])
     QScopedPointer<QQuickView> view(new QQuickView);
 #endif
 
+    // Lets the camera plugin log its startup marks relative to the same start.
+    app->setProperty("cameraStartupTime", startupTimer.msecsSinceReference());
+
     QString path(QLatin1String(DEPLOYMENT_PATH));
 
     view->engine()->setBaseUrl(QUrl::fromLocalFile(path));
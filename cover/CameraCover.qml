@@ -48,19 +48,39 @@ CoverBackground {
         snapMode: ListView.SnapOneItem
 
         delegate: Item {
+            readonly property real thumbnailWidth: galleryActive
+                                                   ? (index === coverIndex ? width : 0.8 * width)
+                                                   : cover.width
+            readonly property real thumbnailHeight: galleryActive
+                                                    ? (index === coverIndex ? height : 0.8 * height)
+                                                    : cover.height
+            readonly property bool thumbnailVisible: galleryActive || index === coverIndex
+
             width: list.width
             height: list.height
 
+            // Photos are scaled by the camera's own thumbnail provider, which can use the
+            // thumbnail embedded in the photo, videos by the system thumbnailer.
+            Image {
+                source: model.thumbnailUrl
+                width: parent.thumbnailWidth
+                height: parent.thumbnailHeight
+                visible: parent.thumbnailVisible && model.thumbnailUrl != ""
+                anchors.centerIn: parent
+                asynchronous: true
+                fillMode: Image.PreserveAspectCrop
+                smooth: true
+                sourceSize.width: width
+                sourceSize.height: height
+                clip: true
+            }
+
             Thumbnail {
-                source: model.url
+                source: model.thumbnailUrl == "" ? model.url : ""
                 mimeType: model.mimeType
-                width: galleryActive
-                       ? (index === coverIndex ? parent.width : 0.8 * parent.width)
-                       : cover.width
-                height: galleryActive
-                        ? (index === coverIndex ? parent.height : 0.8 * parent.height)
-                        : cover.height
-                visible: galleryActive || index === coverIndex
+                width: parent.thumbnailWidth
+                height: parent.thumbnailHeight
+                visible: parent.thumbnailVisible && model.thumbnailUrl == ""
                 anchors.centerIn: parent
                 smooth: true
                 sourceSize.width: width
@@ -31,6 +31,18 @@ GalleryView {
             remove(index)
         }
     }
+
+    Connections {
+        target: Settings
+        onCaptureMoved: {
+            for (var i = 0; i < captureModel.count; ++i) {
+                if (captureModel.get(i).url == url + "") {
+                    captureModel.setProperty(i, "url", movedUrl + "")
+                    break
+                }
+            }
+        }
+    }
     overlay.sharingAllowed: false
     overlay.ambienceAllowed: false
     overlay.additionalActions: IconButton {
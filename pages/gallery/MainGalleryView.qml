@@ -13,10 +13,16 @@ GalleryView {
     captureModel: CaptureModel {
         id: model
 
-        directories: Settings.storagePathStatus, [
-            Settings.photoDirectory,
-            Settings.videoDirectory
-        ]
+        directories: Settings.storagePathStatus, Settings.stagingDirectory !== ""
+                ? [ Settings.photoDirectory, Settings.videoDirectory, Settings.stagingDirectory ]
+                : [ Settings.photoDirectory, Settings.videoDirectory ]
+    }
+
+    Connections {
+        target: Settings
+        onCaptureRecovered: model.appendCapture(url, mimeType)
+        onCaptureMoved: model.moveCapture(url, movedUrl)
+        onStorageDirectoriesCreated: model.refreshDirectories()
     }
 
     ViewPlaceholder {
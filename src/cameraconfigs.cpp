@@ -11,6 +11,16 @@
 #include <QCameraImageCapture>
 #include <mdconfitem.h>
 
+#include <limits>
+
+namespace {
+
+// A card must be measured writing at least this many times faster than a recording, to leave
+// room for the stalls of a card doing housekeeping, and for other writes.
+const int storageWriteHeadroom = 2;
+
+}
+
 CameraConfigs::CameraConfigs(QObject *parent)
     : QObject(parent)
 {
@@ -99,7 +109,7 @@ void CameraConfigs::handleStatus()
             QList<QMediaRecorder *> recorders = qmlRecorder->findChildren<QMediaRecorder *>();
             if (recorders.count() > 0) {
                 QMediaRecorder *recorder = recorders[0];
-                m_supportedVideoResolutions.clear();
+                m_recorderVideoResolutions.clear();
 
                 QSize maxVideoResolution;
                 QVariant value(MDConfItem("/apps/jolla-camera/maxVideoResolution").value());
@@ -113,10 +123,11 @@ void CameraConfigs::handleStatus()
                 for (const QSize resolution : recorder->supportedResolutions()) {
                     if (!maxVideoResolution.isValid() || (resolution.height() <= maxVideoResolution.height()
                                                           && resolution.width() <= maxVideoResolution.width())) {
-                        m_supportedVideoResolutions.append(resolution);
+                        m_recorderVideoResolutions.append(resolution);
                     }
                 }
             }
+            updateSupportedVideoResolutions();
 
             m_supportedIsoSensitivities.clear();
             for (int value : m_camera->exposure()->supportedIsoSensitivities()) {
@@ -203,6 +214,7 @@ void CameraConfigs::handleStatus()
         } else if (!m_camera) {
             m_supportedViewfinderResolutions.clear();
             m_supportedImageResolutions.clear();
+            m_recorderVideoResolutions.clear();
             m_supportedVideoResolutions.clear();
             m_supportedIsoSensitivities.clear();
             m_supportedWhiteBalanceModes.clear();
@@ -247,6 +259,61 @@ QVariantList CameraConfigs::supportedVideoResolutions() const
     return m_supportedVideoResolutions;
 }
 
+qint64 CameraConfigs::storageWriteRate() const
+{
+    return m_storageWriteRate;
+}
+
+void CameraConfigs::setStorageWriteRate(qint64 rate)
+{
+    if (m_storageWriteRate != rate) {
+        m_storageWriteRate = rate;
+
+        emit storageWriteRateChanged();
+        emit maximumVideoBitRateChanged();
+
+        const QVariantList previousResolutions = m_supportedVideoResolutions;
+        updateSupportedVideoResolutions();
+        if (m_ready && m_supportedVideoResolutions != previousResolutions) {
+            emit supportedVideoResolutionsChanged();
+        }
+    }
+}
+
+int CameraConfigs::maximumVideoBitRate() const
+{
+    return m_storageWriteRate > 0
+            ? int(qMin<qint64>(m_storageWriteRate * 8 / storageWriteHeadroom, std::numeric_limits<int>::max()))
+            : 0;
+}
+
+// Leaves out the video resolutions a memory card can't keep up with.  The configured bit rate
+// is for 1080p, larger resolutions are expected to need proportionally more.  The smallest
+// resolution is always kept.
+void CameraConfigs::updateSupportedVideoResolutions()
+{
+    m_supportedVideoResolutions.clear();
+
+    const qint64 maximumBitRate = maximumVideoBitRate();
+    const qint64 bitRate = MDConfItem("/apps/jolla-camera/videoBitRate").value(12000000).toLongLong();
+    const qint64 referencePixels = 1920 * 1080;
+
+    QSize smallest;
+    for (const QSize resolution : m_recorderVideoResolutions) {
+        const qint64 pixels = qint64(resolution.width()) * resolution.height();
+        if (maximumBitRate == 0 || bitRate * qMax(pixels, referencePixels) / referencePixels <= maximumBitRate) {
+            m_supportedVideoResolutions.append(resolution);
+        }
+        if (!smallest.isValid() || pixels < qint64(smallest.width()) * smallest.height()) {
+            smallest = resolution;
+        }
+    }
+
+    if (m_supportedVideoResolutions.isEmpty() && smallest.isValid()) {
+        m_supportedVideoResolutions.append(smallest);
+    }
+}
+
 QVariantList CameraConfigs::supportedIsoSensitivities() const
 {
     return m_supportedIsoSensitivities;
@@ -37,6 +37,12 @@ class CameraConfigs : public QObject
     Q_PROPERTY(QVariantList supportedMeteringModes READ supportedMeteringModes NOTIFY supportedMeteringModesChanged)
     Q_PROPERTY(QVariantList supportedFlashModes READ supportedFlashModes NOTIFY supportedFlashModesChanged)
 
+    // The measured write rate of the storage recordings are saved to in bytes per second, or -1
+    // if it's not known.  Video resolutions needing more than it can sustain are not supported.
+    Q_PROPERTY(qint64 storageWriteRate READ storageWriteRate WRITE setStorageWriteRate NOTIFY storageWriteRateChanged)
+    // The largest video bit rate the storage can sustain, or 0 if there's no limit.
+    Q_PROPERTY(int maximumVideoBitRate READ maximumVideoBitRate NOTIFY maximumVideoBitRateChanged)
+
 public:
     enum AspectRatio {
         AspectRatio_4_3,
@@ -62,6 +68,10 @@ public:
     QVariantList supportedMeteringModes() const;
     QVariantList supportedFlashModes() const;
 
+    qint64 storageWriteRate() const;
+    void setStorageWriteRate(qint64 rate);
+    int maximumVideoBitRate() const;
+
     void setCamera(QObject *camera);
     QObject *camera() const;
 
@@ -81,6 +91,8 @@ signals:
     void supportedFocusPointModesChanged();
     void supportedMeteringModesChanged();
     void supportedFlashModesChanged();
+    void storageWriteRateChanged();
+    void maximumVideoBitRateChanged();
 
 private slots:
     void handleStatus();
@@ -88,6 +100,8 @@ private slots:
     void handleCaptureMode();
 
 private:
+    void updateSupportedVideoResolutions();
+
     bool m_ready = false;
     QCamera *m_camera = nullptr;
     QObject *m_qmlCamera = nullptr;
@@ -102,6 +116,8 @@ private:
     QVariantList m_supportedFocusPointModes;
     QVariantList m_supportedMeteringModes;
     QVariantList m_supportedFlashModes;
+    QList<QSize> m_recorderVideoResolutions;
+    qint64 m_storageWriteRate = -1;
 };
 
 #endif // CAMERACONFIGS_H
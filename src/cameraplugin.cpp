@@ -12,6 +12,8 @@
 #include <qqml.h>
 
 #include "capturemodel.h"
+#include "capturesectionmodel.h"
+#include "capturethumbnailprovider.h"
 #include "declarativecameraextensions.h"
 #include "declarativesettings.h"
 #include "cameraconfigs.h"
@@ -48,13 +50,14 @@ public:
     void initializeEngine(QQmlEngine *engine, const char *uri)
     {
         Q_UNUSED(uri)
-        Q_UNUSED(engine)
         Q_ASSERT(QLatin1String(uri) == QLatin1String("com.jolla.camera"));
 
         AppTranslator *engineeringEnglish = new AppTranslator(engine);
         AppTranslator *translator = new AppTranslator(engine);
         engineeringEnglish->load("jolla-camera_eng_en", "/usr/share/translations");
         translator->load(QLocale(), "jolla-camera", "-", "/usr/share/translations");
+
+        engine->addImageProvider(CaptureThumbnailProvider::providerId(), new CaptureThumbnailProvider);
     }
 
     virtual void registerTypes(const char *uri)
@@ -63,6 +66,11 @@ public:
         Q_ASSERT(QLatin1String(uri) == QLatin1String("com.jolla.camera"));
 
         qmlRegisterType<CaptureModel>("com.jolla.camera", 1, 0, "CaptureModel");
+        qmlRegisterType<CaptureSectionModel>("com.jolla.camera", 1, 0, "CaptureSectionModel");
+        qmlRegisterUncreatableType<CaptureModelStatistics>("com.jolla.camera", 1, 0, "CaptureModelStatistics",
+                                                           QStringLiteral("Provided by CaptureModel.stats"));
+        qmlRegisterUncreatableType<CaptureMigration>("com.jolla.camera", 1, 0, "CaptureMigration",
+                                                     QStringLiteral("Provided by Settings.migration"));
         qmlRegisterType<DeclarativeCameraExtensions>("com.jolla.camera", 1, 0, "CameraExtensions");
         qmlRegisterType<DeclarativeSettings>("com.jolla.camera", 1, 0, "SettingsBase");
         qmlRegisterSingletonType<DeclarativeSettings>("com.jolla.camera", 1, 0, "Settings", DeclarativeSettings::factory);
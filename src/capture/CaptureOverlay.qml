@@ -29,7 +29,11 @@ SettingsOverlay {
     property int _recSecsRemaining: {
         var totalBitRate = (camera.videoRecorder.videoBitRate + camera.videoRecorder.audioBitRate) * 1.05
         var maxDuration = Settings.storageMaxFileSize * 8 / totalBitRate
-        return maxDuration - _recordingDuration
+        // The file size limit is fixed when recording starts, the free space is monitored
+        // throughout.
+        return Settings.storageSecondsRemaining >= 0
+                ? Math.min(maxDuration - _recordingDuration, Settings.storageSecondsRemaining)
+                : maxDuration - _recordingDuration
     }
 
     property var _startTime: new Date()
@@ -136,12 +140,21 @@ SettingsOverlay {
         previousStoragePathStatus.value = Settings.storagePathStatus
 
         // Refresh the remaining storage space, in case it was modified while we weren't active
-        // TODO: Do this regularly throughout recording, if it doesn't interfere.
         if (!captureView.recording) {
             Settings.refreshMaxFileSize()
         }
     }
 
+    Connections {
+        target: Settings
+        onStorageSpaceLow: {
+            if (camera.captureMode == Camera.CaptureVideo && Qt.application.state == Qt.ApplicationActive) {
+                //% "Storage is almost full"
+                notification.publishMessage(qsTrId("camera-me-storage-almost-full"))
+            }
+        }
+    }
+
     PositionSource {
         id: positionSource
 
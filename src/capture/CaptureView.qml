@@ -392,6 +392,15 @@ FocusScope {
         }
     }
 
+    Connections {
+        target: Settings
+        onCaptureCompleted: {
+            if (completedUrl != "") {
+                captureView.recordingStopped(completedUrl, camera.videoRecorder.mediaContainer)
+            }
+        }
+    }
+
     Connections {
         target: CameraConfigs
         onReadyChanged: {
@@ -462,10 +471,7 @@ FocusScope {
             if (videoRecorder.recorderState == CameraRecorder.StoppedState) {
                 videoRecorder.recorderStateChanged.disconnect(_finishRecording)
                 extensions.disableNotifications(captureView, false)
-                var finalUrl = Settings.completeCapture(videoRecorder.outputLocation)
-                if (finalUrl != "") {
-                    captureView.recordingStopped(finalUrl, videoRecorder.mediaContainer)
-                }
+                Settings.completeCapture(videoRecorder.outputLocation)
                 recordStopEvent.play()
             }
         }
@@ -617,7 +623,9 @@ FocusScope {
             mediaContainer: Settings.global.mediaContainer
 
             videoEncodingMode: Settings.global.videoEncodingMode
-            videoBitRate: Settings.global.videoBitRate
+            videoBitRate: CameraConfigs.maximumVideoBitRate > 0
+                          ? Math.min(Settings.global.videoBitRate, CameraConfigs.maximumVideoBitRate)
+                          : Settings.global.videoBitRate
         }
         focus {
             // could expect that locking focus on auto or continous behaves the same, but
@@ -686,6 +694,24 @@ FocusScope {
         value: camera
     }
 
+    Binding {
+        target: CameraConfigs
+        property: "storageWriteRate"
+        value: Settings.storageWriteRate
+    }
+
+    Binding {
+        target: Settings
+        property: "recordingBitRate"
+        value: (camera.videoRecorder.videoBitRate + camera.videoRecorder.audioBitRate) * 1.05
+    }
+
+    Binding {
+        target: Settings
+        property: "recording"
+        value: captureView.recording
+    }
+
     DeviceInfo {
         id: deviceInfo
     }
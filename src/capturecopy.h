@@ -0,0 +1,163 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef CAPTURECOPY_H
+#define CAPTURECOPY_H
+
+#include <QByteArray>
+
+#include "capturefilename.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// Helpers for moving captures between storages.  The file contents are copied in the kernel with
+// copy_file_range(), which can't copy between filesystems before Linux 5.3, then with sendfile()
+// and failing that through a buffer.
+
+enum : qint64 {
+    CaptureCopyChunkSize = 1 << 20
+};
+
+// Copies the remainder of source to target a chunk at a time, calling progress with the number of
+// bytes copied after each chunk.  The copy is abandoned with ECANCELED if progress returns false.
+template <class Progress> inline bool copyCaptureFile(int source, int target, const Progress &progress)
+{
+    enum { CopyFileRange, SendFile, ReadWrite } method = CopyFileRange;
+    QByteArray buffer;
+
+    for (;;) {
+        ssize_t count = -1;
+        if (method == CopyFileRange) {
+            count = copy_file_range(source, nullptr, target, nullptr, CaptureCopyChunkSize, 0);
+            if (count < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                method = SendFile;
+                continue;
+            }
+        } else if (method == SendFile) {
+            count = sendfile(target, source, nullptr, CaptureCopyChunkSize);
+            if (count < 0 && (errno == ENOSYS || errno == EINVAL)) {
+                method = ReadWrite;
+                buffer.resize(CaptureCopyChunkSize);
+                continue;
+            }
+        } else {
+            count = ::read(source, buffer.data(), buffer.size());
+            if (count > 0 && ::write(target, buffer.constData(), count) != count) {
+                count = -1;
+            }
+        }
+
+        if (count < 0) {
+            return false;
+        } else if (count == 0) {
+            return true;
+        }
+
+        if (!progress(count)) {
+            errno = ECANCELED;
+            return false;
+        }
+    }
+}
+
+// Compares the whole contents of two files.  The cached pages of the target are dropped first so
+// it's read back from the storage it was written to.
+inline bool compareCaptureFiles(int source, int target)
+{
+    struct stat sourceStat;
+    struct stat targetStat;
+    if (fstat(source, &sourceStat) != 0
+            || fstat(target, &targetStat) != 0
+            || sourceStat.st_size != targetStat.st_size
+            || lseek(source, 0, SEEK_SET) != 0
+            || lseek(target, 0, SEEK_SET) != 0) {
+        return false;
+    }
+
+    posix_fadvise(target, 0, 0, POSIX_FADV_DONTNEED);
+
+    QByteArray sourceBuffer(CaptureCopyChunkSize, Qt::Uninitialized);
+    QByteArray targetBuffer(CaptureCopyChunkSize, Qt::Uninitialized);
+
+    for (;;) {
+        const ssize_t count = ::read(source, sourceBuffer.data(), sourceBuffer.size());
+        if (count < 0) {
+            return false;
+        } else if (count == 0) {
+            return ::read(target, targetBuffer.data(), 1) == 0;
+        }
+
+        ssize_t targetCount = 0;
+        while (targetCount < count) {
+            const ssize_t read = ::read(target, targetBuffer.data() + targetCount, count - targetCount);
+            if (read <= 0) {
+                return false;
+            }
+            targetCount += read;
+        }
+
+        if (memcmp(sourceBuffer.constData(), targetBuffer.constData(), count) != 0) {
+            return false;
+        }
+    }
+}
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+// Renames a file without replacing one which already has the new name, failing with EEXIST if
+// there is one.  Where renameat2() doesn't support RENAME_NOREPLACE the name is only checked
+// before an ordinary rename(), so a file created in between by another writer is replaced.  A
+// hard link isn't used instead because it is reported by inotify as IN_CREATE, which the capture
+// model doesn't add captures for, where rename() is reported as IN_MOVED_TO.
+inline bool renameCaptureFile(const char *path, const char *newPath)
+{
+#ifdef SYS_renameat2
+    if (syscall(SYS_renameat2, AT_FDCWD, path, AT_FDCWD, newPath, RENAME_NOREPLACE) == 0) {
+        return true;
+    } else if (errno != ENOSYS && errno != EINVAL) {
+        return false;
+    }
+#endif
+
+    if (::access(newPath, F_OK) == 0) {
+        errno = EEXIST;
+        return false;
+    }
+
+    return ::rename(path, newPath) == 0;
+}
+
+// Renames a copy of a capture named fileName into directory, giving it the next free sequence
+// number if the name is already in use.  Returns the path it was renamed to, or an empty path if
+// fileName isn't a capture, every sequence number is in use or the rename fails.
+inline QByteArray renameCaptureFile(const QByteArray &path, const QByteArray &directory, const QByteArray &fileName)
+{
+    quint64 key;
+    if (!parseCaptureFileName(fileName.constData(), &key)) {
+        errno = EINVAL;
+        return QByteArray();
+    }
+
+    QByteArray targetPath = directory + '/' + fileName;
+    for (quint64 sequence = 1; !renameCaptureFile(path.constData(), targetPath.constData()); ++sequence) {
+        if (errno != EEXIST || sequence > 999) {
+            return QByteArray();
+        }
+        // Replace the sequence number and its digit count with a three digit number.
+        targetPath = directory + '/' + captureFileName((key & ~Q_UINT64_C(0x1fffe)) | (sequence << 4) | (3 << 1));
+    }
+    return targetPath;
+}
+
+#endif
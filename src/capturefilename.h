@@ -0,0 +1,133 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef CAPTUREFILENAME_H
+#define CAPTUREFILENAME_H
+
+#include <QByteArray>
+#include <QDateTime>
+
+#include <string.h>
+
+// Camera files are named yyyyMMdd_HHmmss[_N].jpg or yyyyMMdd_HHmmss[_N].mp4.  The sort key packs
+// the fields of the name so that captures sort by the date and time they were taken.  The date
+// and time occupy the high bits as a single decimal number, followed by the sequence number, the
+// number of digits the sequence number was written with and lastly whether the file is a video.
+// Within a second captures sort by the value of the sequence number, which differs from the
+// order of the names where the number of digits varies: _10 follows _9 and _01 follows _1 in
+// the names but precedes them in the keys.  The camera writes sequence numbers with three
+// digits, for which both orders agree.
+//
+// The sequence number has 13 bits, names with a sequence number above 8191 aren't recognized as
+// captures.  The camera never numbers that many captures within a single second.
+//
+//   63 .. 17           16 .. 4      3 .. 1        0
+//   yyyyMMddHHmmss     sequence     digits        mp4
+//
+// The parser works directly on the names returned by getdents64() and inotify so directory
+// entries can be filtered without allocating.
+inline bool parseCaptureFileName(const char *fileName, quint64 *key)
+{
+    quint64 dateTime = 0;
+    for (int i = 0; i < 15; ++i) {
+        const char c = fileName[i];
+        if (i == 8) {
+            if (c != '_') {
+                return false;
+            }
+        } else if (c >= '0' && c <= '9') {
+            dateTime = dateTime * 10 + (c - '0');
+        } else {
+            return false;
+        }
+    }
+
+    const char *at = fileName + 15;
+
+    quint64 sequence = 0;
+    quint64 digits = 0;
+    if (*at == '_') {
+        for (++at; *at >= '0' && *at <= '9'; ++at) {
+            if (++digits > 7) {
+                return false;
+            }
+            sequence = sequence * 10 + (*at - '0');
+        }
+        if (digits == 0 || sequence > 0x1fff) {
+            return false;
+        }
+    }
+
+    quint64 video;
+    if (at[0] != '.') {
+        return false;
+    } else if (at[1] == 'j' && at[2] == 'p' && at[3] == 'g' && at[4] == '\0') {
+        video = 0;
+    } else if (at[1] == 'm' && at[2] == 'p' && at[3] == '4' && at[4] == '\0') {
+        video = 1;
+    } else {
+        return false;
+    }
+
+    *key = (dateTime << 17) | (sequence << 4) | (digits << 1) | video;
+
+    return true;
+}
+
+inline QByteArray captureFileName(quint64 key)
+{
+    char buffer[32];
+    char *at = buffer + 15;
+
+    quint64 dateTime = key >> 17;
+    for (int i = 14; i >= 0; --i) {
+        if (i == 8) {
+            buffer[i] = '_';
+        } else {
+            buffer[i] = '0' + dateTime % 10;
+            dateTime /= 10;
+        }
+    }
+
+    const int digits = (key >> 1) & 0x7;
+    if (digits > 0) {
+        quint64 sequence = (key >> 4) & 0x1fff;
+
+        *at = '_';
+        for (int i = digits; i > 0; --i) {
+            at[i] = '0' + sequence % 10;
+            sequence /= 10;
+        }
+        at += digits + 1;
+    }
+
+    memcpy(at, key & 1 ? ".mp4" : ".jpg", 4);
+
+    return QByteArray(buffer, at + 4 - buffer);
+}
+
+// The date a capture was taken on as the decimal number yyyyMMdd.
+inline int captureDateNumber(quint64 key)
+{
+    return int((key >> 17) / Q_UINT64_C(1000000));
+}
+
+// The local time a capture was taken at, as recorded in its file name.
+inline QDateTime captureDateTime(quint64 key)
+{
+    quint64 dateTime = key >> 17;
+
+    const int second = dateTime % 100;
+    const int minute = (dateTime /= 100) % 100;
+    const int hour = (dateTime /= 100) % 100;
+    const int day = (dateTime /= 100) % 100;
+    const int month = (dateTime /= 100) % 100;
+    const int year = dateTime / 100;
+
+    return QDateTime(QDate(year, month, day), QTime(hour, minute, second));
+}
+
+#endif
@@ -0,0 +1,241 @@
+// SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "captureindex.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <limits>
+
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace {
+
+const char indexMagic[4] = { 'J', 'C', 'C', 'I' };
+const quint32 indexVersion = 3;
+
+// Directory modification times on vfat only have a two second resolution, a listing taken
+// within that window of the last modification may have missed a file without the modification
+// time changing.
+const qint64 modificationResolution = Q_INT64_C(2000000000);
+
+inline quint64 alignedSize(quint64 size)
+{
+    return (size + 7) & ~Q_UINT64_C(7);
+}
+
+}
+
+struct CaptureIndex::Header
+{
+    char magic[4];
+    quint32 version;
+    quint32 directoryLength;
+    quint32 count;
+    quint32 subdirectoryCount;
+    quint32 reserved;
+    quint64 device;
+    quint64 inode;
+    qint64 modified;
+    qint64 scanned;
+};
+
+CaptureIndex::CaptureIndex()
+{
+}
+
+CaptureIndex::~CaptureIndex()
+{
+    close();
+}
+
+bool CaptureIndex::open(const QString &filePath, const QByteArray &directory)
+{
+    close();
+
+    const int fd = ::open(QFile::encodeName(filePath).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    // The header is validated against the size of the file before anything is mapped.  Sizes
+    // are computed in 64 bits and each count is bounded by the space left in the file, so a
+    // corrupt header can't overflow them on a 32-bit system.
+    Header header;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0
+            || fileStat.st_size < qint64(sizeof(Header))
+            || quint64(fileStat.st_size) > std::numeric_limits<size_t>::max()
+            || pread(fd, &header, sizeof(Header), 0) != qint64(sizeof(Header))) {
+        ::close(fd);
+        return false;
+    }
+
+    const quint64 fileSize = fileStat.st_size;
+    const quint64 directoryEnd = sizeof(Header) + alignedSize(header.directoryLength);
+    const quint64 keysEnd = directoryEnd + quint64(header.count) * sizeof(quint64);
+
+    if (memcmp(header.magic, indexMagic, sizeof(indexMagic)) != 0
+            || header.version != indexVersion
+            || header.directoryLength != quint32(directory.length())
+            || directoryEnd > fileSize
+            || header.count > (fileSize - directoryEnd) / sizeof(quint64)
+            || header.count > quint32(std::numeric_limits<int>::max())
+            || header.subdirectoryCount > (fileSize - keysEnd) / sizeof(quint32)
+            || keysEnd + quint64(header.subdirectoryCount) * sizeof(quint32) != fileSize) {
+        ::close(fd);
+        return false;
+    }
+
+    void * const data = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    m_data = data;
+    m_size = fileSize;
+
+    const char * const begin = static_cast<const char *>(data);
+
+    if (memcmp(begin + sizeof(Header), directory.constData(), directory.length()) != 0) {
+        close();
+        return false;
+    }
+
+    m_header = static_cast<const Header *>(data);
+    m_keys = reinterpret_cast<const quint64 *>(begin + directoryEnd);
+    m_subdirectories = reinterpret_cast<const quint32 *>(begin + keysEnd);
+
+    return true;
+}
+
+void CaptureIndex::close()
+{
+    if (m_data) {
+        munmap(m_data, m_size);
+    }
+    m_header = nullptr;
+    m_keys = nullptr;
+    m_subdirectories = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+}
+
+CaptureIndex::State CaptureIndex::state() const
+{
+    State state;
+    if (m_header) {
+        state.device = m_header->device;
+        state.inode = m_header->inode;
+        state.modified = m_header->modified;
+    }
+    return state;
+}
+
+bool CaptureIndex::isTrusted() const
+{
+    return m_header && m_header->modified + modificationResolution < m_header->scanned;
+}
+
+int CaptureIndex::count() const
+{
+    return m_header ? int(m_header->count) : 0;
+}
+
+quint64 CaptureIndex::key(int index) const
+{
+    return m_keys[index];
+}
+
+int CaptureIndex::subdirectoryCount() const
+{
+    return m_header ? int(m_header->subdirectoryCount) : 0;
+}
+
+quint32 CaptureIndex::subdirectory(int index) const
+{
+    return m_subdirectories[index];
+}
+
+QString CaptureIndex::filePath(const QString &cacheDirectory, const QByteArray &directory)
+{
+    return cacheDirectory
+            + QLatin1Char('/')
+            + QString::fromLatin1(QCryptographicHash::hash(directory, QCryptographicHash::Sha1).toHex())
+            + QLatin1String(".index");
+}
+
+bool CaptureIndex::readState(const QByteArray &directory, State *state)
+{
+    struct stat directoryStat;
+    if (stat(directory.constData(), &directoryStat) != 0) {
+        return false;
+    }
+
+    state->device = directoryStat.st_dev;
+    state->inode = directoryStat.st_ino;
+    state->modified = qint64(directoryStat.st_mtim.tv_sec) * 1000000000 + directoryStat.st_mtim.tv_nsec;
+
+    return true;
+}
+
+qint64 CaptureIndex::currentTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return qint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+bool CaptureIndex::write(
+        const QString &filePath,
+        const QByteArray &directory,
+        const State &state,
+        qint64 scanTime,
+        const QVector<quint64> &keys,
+        const QVector<quint32> &subdirectories)
+{
+    Header header;
+    memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version = indexVersion;
+    header.directoryLength = directory.length();
+    header.count = keys.count();
+    header.subdirectoryCount = subdirectories.count();
+    header.reserved = 0;
+    header.device = state.device;
+    header.inode = state.inode;
+    header.modified = state.modified;
+    header.scanned = scanTime;
+
+    QByteArray paddedDirectory = directory;
+    paddedDirectory.append(QByteArray(int(alignedSize(directory.length())) - directory.length(), '\0'));
+
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    file.write(paddedDirectory);
+    file.write(reinterpret_cast<const char *>(keys.constData()), keys.count() * sizeof(quint64));
+    file.write(
+                reinterpret_cast<const char *>(subdirectories.constData()),
+                subdirectories.count() * sizeof(quint32));
+
+    return file.commit();
+}
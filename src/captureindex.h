@@ -0,0 +1,76 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef CAPTUREINDEX_H
+#define CAPTUREINDEX_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// A cached listing of the camera files in a directory.  The index file is written after a
+// directory has been scanned and can be memory mapped on the next launch so the captures can be
+// shown before the directory itself has been read.  Captures are recorded by the sort keys
+// CaptureModel decodes from their file names, and the date subdirectories of the directory by
+// the numbers they are named for.
+class CaptureIndex
+{
+public:
+    struct State
+    {
+        bool operator ==(const State &other) const
+        {
+            return device == other.device && inode == other.inode && modified == other.modified;
+        }
+        bool operator !=(const State &other) const
+        {
+            return !(*this == other);
+        }
+
+        quint64 device = 0;
+        quint64 inode = 0;
+        qint64 modified = 0;    // nanoseconds since the epoch
+    };
+
+    CaptureIndex();
+    ~CaptureIndex();
+
+    bool open(const QString &filePath, const QByteArray &directory);
+    void close();
+
+    State state() const;
+    bool isTrusted() const;
+
+    int count() const;
+    quint64 key(int index) const;
+
+    int subdirectoryCount() const;
+    quint32 subdirectory(int index) const;
+
+    static QString filePath(const QString &cacheDirectory, const QByteArray &directory);
+    static bool readState(const QByteArray &directory, State *state);
+    static qint64 currentTime();
+    static bool write(
+            const QString &filePath,
+            const QByteArray &directory,
+            const State &state,
+            qint64 scanTime,
+            const QVector<quint64> &keys,
+            const QVector<quint32> &subdirectories);
+
+private:
+    Q_DISABLE_COPY(CaptureIndex)
+
+    struct Header;
+
+    const Header *m_header = nullptr;
+    const quint64 *m_keys = nullptr;
+    const quint32 *m_subdirectories = nullptr;
+    void *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+#endif
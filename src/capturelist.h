@@ -0,0 +1,135 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef CAPTURELIST_H
+#define CAPTURELIST_H
+
+#include <QVector>
+
+#include <string.h>
+#include <type_traits>
+
+// A vector with free space at both ends of its storage.  Captures are listed newest first so a
+// new capture is almost always inserted at the front, which with a plain QVector means moving
+// every existing element.  Here an insertion or removal moves whichever side of the position is
+// shorter, making changes at either end amortized constant time while rows stay contiguous for
+// random access and binary searches.
+//
+// The storage is implicitly shared so copying a list is cheap until one of the copies is
+// modified.
+template <typename T>
+class CaptureList
+{
+    static_assert(std::is_trivially_copyable<T>::value, "CaptureList elements are moved with memmove");
+
+public:
+    typedef const T *const_iterator;
+
+    CaptureList() = default;
+    CaptureList(const QVector<T> &vector)
+        : m_data(vector)
+        , m_end(vector.count())
+    {
+    }
+
+    int count() const { return m_end - m_begin; }
+    bool isEmpty() const { return m_end == m_begin; }
+
+    const T &at(int index) const { return m_data.constData()[m_begin + index]; }
+
+    const_iterator constBegin() const { return m_data.constData() + m_begin; }
+    const_iterator constEnd() const { return m_data.constData() + m_end; }
+
+    QVector<T> toVector() const
+    {
+        return m_begin == 0 && m_end == m_data.count() ? m_data : m_data.mid(m_begin, count());
+    }
+
+    void insert(int index, const T &value)
+    {
+        insert(index, &value, 1);
+    }
+
+    void insert(int index, const T *values, int count)
+    {
+        const int size = m_end - m_begin;
+
+        if (index < size - index) {
+            if (m_begin < count) {
+                reallocate(count);
+            }
+            T * const data = m_data.data();
+            memmove(data + m_begin - count, data + m_begin, index * sizeof(T));
+            m_begin -= count;
+        } else {
+            if (m_data.count() - m_end < count) {
+                reallocate(count);
+            }
+            T * const data = m_data.data();
+            memmove(data + m_begin + index + count,
+                    data + m_begin + index,
+                    (size - index) * sizeof(T));
+            m_end += count;
+        }
+
+        memcpy(m_data.data() + m_begin + index, values, count * sizeof(T));
+    }
+
+    void remove(int index, int count)
+    {
+        const int size = m_end - m_begin;
+
+        T * const data = m_data.data();
+        if (index < size - index - count) {
+            memmove(data + m_begin + count, data + m_begin, index * sizeof(T));
+            m_begin += count;
+        } else {
+            memmove(data + m_begin + index,
+                    data + m_begin + index + count,
+                    (size - index - count) * sizeof(T));
+            m_end -= count;
+        }
+    }
+
+    void removeAt(int index)
+    {
+        remove(index, 1);
+    }
+
+    void replace(int index, const T &value)
+    {
+        m_data.data()[m_begin + index] = value;
+    }
+
+    void clear()
+    {
+        m_data.clear();
+        m_begin = 0;
+        m_end = 0;
+    }
+
+private:
+    void reallocate(int count)
+    {
+        // Leave an equal amount of free space at either end, proportional to the size so growth
+        // remains amortized whichever end the insertions happen at.
+        const int size = m_end - m_begin;
+        const int space = qMax(size / 2, count) + 8;
+
+        QVector<T> data(space + size + space);
+        memcpy(data.data() + space, m_data.constData() + m_begin, size * sizeof(T));
+
+        m_data = data;
+        m_begin = space;
+        m_end = space + size;
+    }
+
+    QVector<T> m_data;
+    int m_begin = 0;
+    int m_end = 0;
+};
+
+#endif
@@ -0,0 +1,449 @@
+// SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "capturemetadata.h"
+#include "capturefilename.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char cacheMagic[4] = { 'J', 'C', 'C', 'M' };
+const quint32 cacheVersion = 2;
+
+// Bounds the amount of a file which is read looking for metadata.
+const qint64 maximumMoovSize = 16 * 1024 * 1024;
+
+struct CacheHeader
+{
+    char magic[4];
+    quint32 version;
+    quint32 directoryLength;
+    quint32 reserved;
+};
+
+struct CacheRecord
+{
+    quint64 key;
+    qint64 fileSize;
+    qint32 width;
+    qint32 height;
+    qint32 duration;
+    quint32 reserved;
+    qint64 modified;
+};
+
+inline qint64 modificationTime(const struct stat &fileStat)
+{
+    return qint64(fileStat.st_mtim.tv_sec) * 1000000000 + fileStat.st_mtim.tv_nsec;
+}
+
+inline quint32 alignedSize(quint32 size)
+{
+    return (size + 7) & ~7u;
+}
+
+QByteArray cacheHeader(const QByteArray &directory)
+{
+    CacheHeader header;
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.directoryLength = directory.length();
+    header.reserved = 0;
+
+    QByteArray data(reinterpret_cast<const char *>(&header), sizeof(CacheHeader));
+    data.append(directory);
+    data.append(QByteArray(alignedSize(directory.length()) - directory.length(), '\0'));
+    return data;
+}
+
+QByteArray cacheRecords(const CaptureMetadataCache::Records &records)
+{
+    QByteArray data;
+    data.reserve(records.count() * sizeof(CacheRecord));
+
+    for (const auto &record : records) {
+        const CacheRecord cacheRecord = {
+            record.first,
+            record.second.fileSize,
+            record.second.width,
+            record.second.height,
+            record.second.duration,
+            0,
+            record.second.modified
+        };
+        data.append(reinterpret_cast<const char *>(&cacheRecord), sizeof(CacheRecord));
+    }
+    return data;
+}
+
+// Reads a value from a TIFF structure in the byte order given in its header.
+template <typename T> bool readTiff(const QByteArray &tiff, quint32 offset, bool bigEndian, T *value)
+{
+    if (offset > quint32(tiff.size()) || tiff.size() - offset < sizeof(T)) {
+        return false;
+    }
+    const uchar * const data = reinterpret_cast<const uchar *>(tiff.constData()) + offset;
+    *value = bigEndian ? qFromBigEndian<T>(data) : qFromLittleEndian<T>(data);
+    return true;
+}
+
+void readExif(const QByteArray &tiff, int *orientation, QByteArray *thumbnail)
+{
+    if (tiff.size() < 8) {
+        return;
+    }
+    const bool bigEndian = tiff.startsWith("MM");
+
+    quint32 ifdOffset = 0;
+    readTiff(tiff, 4, bigEndian, &ifdOffset);
+
+    quint32 thumbnailOffset = 0;
+    quint32 thumbnailLength = 0;
+
+    // IFD0 describes the main image and IFD1 the thumbnail.
+    for (int ifd = 0; ifd < 2 && ifdOffset != 0; ++ifd) {
+        quint16 entryCount = 0;
+        if (!readTiff(tiff, ifdOffset, bigEndian, &entryCount)) {
+            return;
+        }
+
+        for (int i = 0; i < entryCount; ++i) {
+            const quint32 entry = ifdOffset + 2 + i * 12;
+
+            quint16 tag = 0;
+            quint16 type = 0;
+            if (!readTiff(tiff, entry, bigEndian, &tag) || !readTiff(tiff, entry + 2, bigEndian, &type)) {
+                return;
+            }
+
+            if (ifd == 0 && tag == 0x0112 && type == 3) {
+                quint16 value = 1;
+                readTiff(tiff, entry + 8, bigEndian, &value);
+                *orientation = value;
+            } else if (ifd == 1 && tag == 0x0201) {
+                readTiff(tiff, entry + 8, bigEndian, &thumbnailOffset);
+            } else if (ifd == 1 && tag == 0x0202) {
+                readTiff(tiff, entry + 8, bigEndian, &thumbnailLength);
+            }
+        }
+
+        if (!readTiff(tiff, ifdOffset + 2 + entryCount * 12, bigEndian, &ifdOffset)) {
+            break;
+        }
+    }
+
+    if (thumbnail
+            && thumbnailLength > 0
+            && thumbnailOffset <= quint32(tiff.size())
+            && thumbnailLength <= tiff.size() - thumbnailOffset) {
+        *thumbnail = tiff.mid(thumbnailOffset, thumbnailLength);
+    }
+}
+
+// Calls function with the type and contents of each of the boxes in the range.
+template <typename Function>
+void forEachBox(const uchar *begin, const uchar *end, const Function &function)
+{
+    while (end - begin >= 8) {
+        quint64 size = qFromBigEndian<quint32>(begin);
+        const uchar * const type = begin + 4;
+        int header = 8;
+
+        if (size == 1) {
+            if (end - begin < 16) {
+                return;
+            }
+            size = qFromBigEndian<quint64>(begin + 8);
+            header = 16;
+        } else if (size == 0) {
+            size = end - begin;
+        }
+
+        if (size < quint64(header) || size > quint64(end - begin)) {
+            return;
+        }
+
+        function(type, begin + header, begin + size);
+
+        begin += size;
+    }
+}
+
+inline bool isBox(const uchar *type, const char *name)
+{
+    return memcmp(type, name, 4) == 0;
+}
+
+void readMoov(const uchar *begin, const uchar *end, CaptureMetadata *metadata)
+{
+    forEachBox(begin, end, [metadata](const uchar *type, const uchar *begin, const uchar *end) {
+        if (isBox(type, "mvhd") && end - begin >= 32) {
+            quint64 timeScale;
+            quint64 duration;
+            if (begin[0] == 1) {
+                timeScale = qFromBigEndian<quint32>(begin + 20);
+                duration = qFromBigEndian<quint64>(begin + 24);
+            } else {
+                timeScale = qFromBigEndian<quint32>(begin + 12);
+                duration = qFromBigEndian<quint32>(begin + 16);
+            }
+            if (timeScale > 0) {
+                metadata->duration = duration * 1000 / timeScale;
+            }
+        } else if (isBox(type, "trak") && metadata->width == 0) {
+            forEachBox(begin, end, [metadata](const uchar *type, const uchar *tkhd, const uchar *tkhdEnd) {
+                if (!isBox(type, "tkhd")) {
+                    return;
+                }
+                // The matrix precedes the dimensions, which are 16.16 fixed point numbers.
+                const int matrix = tkhd[0] == 1 ? 52 : 40;
+                if (tkhdEnd - tkhd < matrix + 44) {
+                    return;
+                }
+                const qint32 width = qFromBigEndian<quint32>(tkhd + matrix + 36) >> 16;
+                const qint32 height = qFromBigEndian<quint32>(tkhd + matrix + 40) >> 16;
+                const bool rotated = qFromBigEndian<quint32>(tkhd + matrix + 4) != 0;
+
+                if (width > 0 && height > 0) {
+                    metadata->width = rotated ? height : width;
+                    metadata->height = rotated ? width : height;
+                }
+            });
+        }
+    });
+}
+
+}
+
+bool CaptureMetadata::isCurrent(const QByteArray &filePath) const
+{
+    struct stat fileStat;
+    return ::stat(filePath.constData(), &fileStat) == 0
+            && fileStat.st_size == fileSize
+            && modificationTime(fileStat) == modified;
+}
+
+bool CaptureMetadata::read(const QByteArray &filePath, bool video, CaptureMetadata *metadata)
+{
+    QFile file(QFile::decodeName(filePath));
+    struct stat fileStat;
+    if (!file.open(QIODevice::ReadOnly) || fstat(file.handle(), &fileStat) != 0) {
+        return false;
+    }
+
+    metadata->fileSize = fileStat.st_size;
+    metadata->modified = modificationTime(fileStat);
+
+    return video ? readMp4(&file, metadata) : readJpeg(&file, metadata);
+}
+
+bool CaptureMetadata::readJpeg(
+        QIODevice *device, CaptureMetadata *metadata, int *orientation, QByteArray *exifThumbnail)
+{
+    int exifOrientation = 1;
+
+    uchar marker[4];
+    if (device->read(reinterpret_cast<char *>(marker), 2) != 2 || marker[0] != 0xff || marker[1] != 0xd8) {
+        return false;
+    }
+
+    for (;;) {
+        if (device->read(reinterpret_cast<char *>(marker), 4) != 4 || marker[0] != 0xff) {
+            return false;
+        }
+
+        const int length = qFromBigEndian<quint16>(marker + 2) - 2;
+
+        if (marker[1] == 0xda || length < 0) {
+            // Start of the image data without a frame header.
+            return false;
+        } else if (marker[1] >= 0xc0 && marker[1] <= 0xcf
+                && marker[1] != 0xc4 && marker[1] != 0xc8 && marker[1] != 0xcc) {
+            // Start of frame, the dimensions follow the sample precision.
+            uchar frame[5];
+            if (device->read(reinterpret_cast<char *>(frame), 5) != 5) {
+                return false;
+            }
+            const qint32 height = qFromBigEndian<quint16>(frame + 1);
+            const qint32 width = qFromBigEndian<quint16>(frame + 3);
+
+            // Orientations 5 to 8 rotate the image by 90 degrees.
+            metadata->width = exifOrientation >= 5 ? height : width;
+            metadata->height = exifOrientation >= 5 ? width : height;
+
+            if (orientation) {
+                *orientation = exifOrientation;
+            }
+            return true;
+        } else if (marker[1] == 0xe1) {
+            const QByteArray segment = device->read(length);
+            if (segment.size() != length) {
+                return false;
+            } else if (segment.startsWith(QByteArray("Exif\0\0", 6))) {
+                readExif(segment.mid(6), &exifOrientation, exifThumbnail);
+            }
+        } else if (!device->seek(device->pos() + length)) {
+            return false;
+        }
+    }
+}
+
+bool CaptureMetadata::readMp4(QIODevice *device, CaptureMetadata *metadata)
+{
+    // The moov box may be at either end of the file, step over the top level boxes until it is
+    // found.
+    const qint64 end = device->size();
+    qint64 position = 0;
+
+    while (end - position >= 8) {
+        uchar header[16];
+        if (!device->seek(position) || device->read(reinterpret_cast<char *>(header), 8) != 8) {
+            return false;
+        }
+
+        qint64 size = qFromBigEndian<quint32>(header);
+        int headerSize = 8;
+
+        if (size == 1) {
+            if (device->read(reinterpret_cast<char *>(header + 8), 8) != 8) {
+                return false;
+            }
+            size = qFromBigEndian<quint64>(header + 8);
+            headerSize = 16;
+        } else if (size == 0) {
+            size = end - position;
+        }
+
+        if (size < headerSize || size > end - position) {
+            return false;
+        } else if (isBox(header + 4, "moov")) {
+            if (size > maximumMoovSize) {
+                return false;
+            }
+            const QByteArray moov = device->read(size - headerSize);
+            const uchar * const data = reinterpret_cast<const uchar *>(moov.constData());
+
+            readMoov(data, data + moov.size(), metadata);
+
+            return true;
+        }
+
+        position += size;
+    }
+    return false;
+}
+
+QString CaptureMetadataCache::filePath(const QString &cacheDirectory, const QByteArray &directory)
+{
+    return cacheDirectory
+            + QLatin1Char('/')
+            + QString::fromLatin1(QCryptographicHash::hash(directory, QCryptographicHash::Sha1).toHex())
+            + QLatin1String(".metadata");
+}
+
+bool CaptureMetadataCache::read(
+        const QString &filePath, const QByteArray &directory, QHash<quint64, CaptureMetadata> *metadata)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray header = cacheHeader(directory);
+    const QByteArray data = file.readAll();
+    file.close();
+
+    if (!data.startsWith(header)) {
+        return false;
+    }
+
+    const int count = (data.size() - header.size()) / int(sizeof(CacheRecord));
+    const qint64 recordsEnd = header.size() + qint64(count) * sizeof(CacheRecord);
+
+    // Truncate a partial record left by an interrupted append, the records appended after it
+    // would be misaligned otherwise.
+    if (data.size() > recordsEnd && !QFile::resize(filePath, recordsEnd)) {
+        return false;
+    }
+
+    const CacheRecord * const records = reinterpret_cast<const CacheRecord *>(
+                data.constData() + header.size());
+
+    for (int i = 0; i < count; ++i) {
+        if (records[i].fileSize < 0) {
+            metadata->remove(records[i].key);
+            continue;
+        }
+        CaptureMetadata &captureMetadata = (*metadata)[records[i].key];
+        captureMetadata.fileSize = records[i].fileSize;
+        captureMetadata.width = records[i].width;
+        captureMetadata.height = records[i].height;
+        captureMetadata.duration = records[i].duration;
+        captureMetadata.modified = records[i].modified;
+    }
+
+    if (count > 2 * metadata->count() + 64) {
+        // Later records replaced or removed earlier ones, rewrite the file without the superseded
+        // records and those of captures deleted while the camera wasn't watching.
+        Records compacted;
+        compacted.reserve(metadata->count());
+        for (auto it = metadata->begin(); it != metadata->end();) {
+            if (access((directory + '/' + captureFileName(it.key())).constData(), F_OK) != 0
+                    && errno == ENOENT) {
+                it = metadata->erase(it);
+            } else {
+                compacted.append(qMakePair(it.key(), it.value()));
+                ++it;
+            }
+        }
+
+        QSaveFile compactedFile(filePath);
+        if (compactedFile.open(QIODevice::WriteOnly)) {
+            compactedFile.write(header);
+            compactedFile.write(cacheRecords(compacted));
+            compactedFile.commit();
+        }
+    }
+
+    return true;
+}
+
+bool CaptureMetadataCache::append(
+        const QString &filePath, const QByteArray &directory, const Records &records)
+{
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return false;
+    }
+
+    const QByteArray header = cacheHeader(directory);
+    if (file.size() < header.size()) {
+        // A new file, or one whose header was cut short.
+        if (!file.resize(0) || file.write(header) != header.size()) {
+            return false;
+        }
+    } else {
+        // Don't append after a partial record left by an earlier write which failed.
+        const qint64 excess = (file.size() - header.size()) % qint64(sizeof(CacheRecord));
+        if (excess != 0 && !file.resize(file.size() - excess)) {
+            return false;
+        }
+    }
+
+    const QByteArray data = cacheRecords(records);
+    return file.write(data) == data.size();
+}
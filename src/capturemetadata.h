@@ -0,0 +1,62 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef CAPTUREMETADATA_H
+#define CAPTUREMETADATA_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+QT_END_NAMESPACE
+
+// The properties of a capture which are read from the file itself.  Only the headers are read,
+// the frame dimensions of a photo come from the JPEG start of frame and those of a video, along
+// with its duration, from the MP4 moov box.
+struct CaptureMetadata
+{
+    bool isValid() const { return fileSize >= 0; }
+
+    // Returns whether the file still has the size and modification time the metadata was read
+    // with, a file which has been replaced since has to be read again.
+    bool isCurrent(const QByteArray &filePath) const;
+
+    static bool read(const QByteArray &filePath, bool video, CaptureMetadata *metadata);
+    static bool readJpeg(
+            QIODevice *device,
+            CaptureMetadata *metadata,
+            int *orientation = nullptr,
+            QByteArray *exifThumbnail = nullptr);
+    static bool readMp4(QIODevice *device, CaptureMetadata *metadata);
+
+    qint64 fileSize = -1;
+    qint32 width = 0;       // as displayed, after applying the orientation
+    qint32 height = 0;
+    qint32 duration = 0;    // milliseconds
+    qint64 modified = 0;    // the modification time of the file, nanoseconds since the epoch
+};
+
+// A file recording the metadata of the captures in a directory, so it only has to be read from
+// the captures once.  New records are appended to the end of the file and the file is compacted
+// when it is next read.  An invalid record removes the capture from the cache.
+class CaptureMetadataCache
+{
+public:
+    typedef QVector<QPair<quint64, CaptureMetadata>> Records;
+
+    static QString filePath(const QString &cacheDirectory, const QByteArray &directory);
+    static bool read(
+            const QString &filePath,
+            const QByteArray &directory,
+            QHash<quint64, CaptureMetadata> *metadata);
+    static bool append(const QString &filePath, const QByteArray &directory, const Records &records);
+};
+
+#endif
@@ -0,0 +1,479 @@
+// SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "capturemigration.h"
+#include "capturecopy.h"
+#include "capturefilename.h"
+
+#include <QAtomicInt>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QRunnable>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QVector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+struct CaptureMigrationState
+{
+    struct File
+    {
+        QString path;
+        QString targetDirectory;
+        qint64 size = 0;
+    };
+
+    QMutex mutex;
+    QVector<File> files;
+    int next = 0;
+    QAtomicInt cancelled;
+};
+
+namespace {
+
+// Lists the captures to be migrated.  Temporary files left in the target directories by an
+// interrupted migration are removed first.  A pair of directories is skipped if either is
+// missing, as the storage it's on may not have been mounted yet.
+class ScanTask : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    ScanTask(
+            const QSharedPointer<CaptureMigrationState> &state,
+            const QStringList &sourceDirectories,
+            const QStringList &targetDirectories,
+            const QDateTime &startTime)
+        : m_state(state)
+        , m_sourceDirectories(sourceDirectories)
+        , m_targetDirectories(targetDirectories)
+        , m_startTime(startTime)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        QVector<CaptureMigrationState::File> files;
+        qint64 bytes = 0;
+        bool complete = true;
+
+        for (int i = 0; i < m_sourceDirectories.count(); ++i) {
+            const QString sourceDirectory = m_sourceDirectories.at(i);
+            const QString targetDirectory = m_targetDirectories.at(i);
+
+            if (!QFileInfo(sourceDirectory).isDir() || !QFileInfo(targetDirectory).isDir()) {
+                complete = false;
+                continue;
+            }
+
+            // A file still being copied by the staging of this instance is newer than the
+            // migration.
+            QDirIterator temporaryFiles(
+                        targetDirectory,
+                        QStringList() << QStringLiteral(".*.migrating"),
+                        QDir::Files | QDir::Hidden,
+                        QDirIterator::Subdirectories);
+            while (temporaryFiles.hasNext()) {
+                const QString path = temporaryFiles.next();
+                if (temporaryFiles.fileInfo().lastModified() < m_startTime) {
+                    QFile::remove(path);
+                }
+            }
+
+            QDirIterator captures(sourceDirectory, QDir::Files, QDirIterator::Subdirectories);
+            while (captures.hasNext()) {
+                CaptureMigrationState::File file;
+                file.path = captures.next();
+
+                quint64 key;
+                if (!parseCaptureFileName(QFile::encodeName(captures.fileName()).constData(), &key)) {
+                    continue;
+                }
+
+                // Captures in date subdirectories are moved to the same subdirectory.
+                file.targetDirectory = targetDirectory + captures.fileInfo().path().mid(sourceDirectory.length());
+                file.size = captures.fileInfo().size();
+
+                bytes += file.size;
+                files.append(file);
+            }
+        }
+
+        {
+            QMutexLocker locker(&m_state->mutex);
+            m_state->files = files;
+            m_state->next = 0;
+        }
+
+        emit scanned(files.count(), bytes, complete);
+    }
+
+signals:
+    void scanned(int count, qint64 bytes, bool complete);
+
+private:
+    const QSharedPointer<CaptureMigrationState> m_state;
+    const QStringList m_sourceDirectories;
+    const QStringList m_targetDirectories;
+    const QDateTime m_startTime;
+};
+
+// Takes files from the migration until there are none left or it's cancelled.  A file is copied
+// to a hidden temporary name in the target directory, synced, read back and compared with the
+// original, and only then renamed to its final name and the original removed.
+class MigrationWorker : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    explicit MigrationWorker(const QSharedPointer<CaptureMigrationState> &state)
+        : m_state(state)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        for (;;) {
+            CaptureMigrationState::File file;
+            {
+                QMutexLocker locker(&m_state->mutex);
+                if (m_state->cancelled.load() != 0 || m_state->next == m_state->files.count()) {
+                    break;
+                }
+                file = m_state->files.at(m_state->next++);
+            }
+
+            const QString targetPath = migrate(file);
+            if (!targetPath.isEmpty()) {
+                emit migrated(QUrl::fromLocalFile(file.path), QUrl::fromLocalFile(targetPath));
+            } else if (errno != ECANCELED) {
+                qWarning() << "Failed to migrate" << file.path << "to" << file.targetDirectory << strerror(errno);
+                emit failed(QUrl::fromLocalFile(file.path));
+            }
+        }
+
+        emit finished();
+    }
+
+signals:
+    void copied(qint64 bytes);
+    void migrated(const QUrl &url, const QUrl &movedUrl);
+    void failed(const QUrl &url);
+    void finished();
+
+private:
+    QString migrate(const CaptureMigrationState::File &file)
+    {
+        const QByteArray sourcePath = QFile::encodeName(file.path);
+        const QByteArray fileName = QFile::encodeName(QFileInfo(file.path).fileName());
+        const QByteArray directory = QFile::encodeName(file.targetDirectory);
+
+        if (!QDir().mkpath(file.targetDirectory)) {
+            return QString();
+        }
+
+        const int source = ::open(sourcePath.constData(), O_RDONLY | O_CLOEXEC);
+        if (source < 0) {
+            return QString();
+        }
+        posix_fadvise(source, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        // A file copied before the migration was interrupted, but not removed from the source.
+        const QByteArray existingPath = directory + '/' + fileName;
+        const int existing = ::open(existingPath.constData(), O_RDONLY | O_CLOEXEC);
+        if (existing >= 0) {
+            const bool identical = compareCaptureFiles(source, existing);
+            ::close(existing);
+
+            if (identical) {
+                ::close(source);
+                ::unlink(sourcePath.constData());
+                emit copied(file.size);
+                return QFile::decodeName(existingPath);
+            } else if (lseek(source, 0, SEEK_SET) != 0) {
+                ::close(source);
+                return QString();
+            }
+        }
+
+        const QByteArray temporaryPath = directory + "/." + fileName + ".migrating";
+        const int target = ::open(temporaryPath.constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (target < 0) {
+            ::close(source);
+            return QString();
+        }
+
+        qint64 copiedBytes = 0;
+        bool ok = copyCaptureFile(source, target, [&](qint64 count) {
+            copiedBytes += count;
+            emit copied(count);
+            return m_state->cancelled.load() == 0;
+        });
+        ok = ok && fdatasync(target) == 0;
+        if (ok && !compareCaptureFiles(source, target)) {
+            errno = EIO;
+            ok = false;
+        }
+
+        ::close(source);
+        ok = ::close(target) == 0 && ok;
+
+        const QByteArray targetPath = ok
+                ? renameCaptureFile(temporaryPath, directory, fileName)
+                : QByteArray();
+
+        if (!targetPath.isEmpty()) {
+            ::unlink(sourcePath.constData());
+            return QFile::decodeName(targetPath);
+        } else {
+            const int error = errno;
+            ::unlink(temporaryPath.constData());
+            emit copied(-copiedBytes);
+            errno = error;
+            return QString();
+        }
+    }
+
+    const QSharedPointer<CaptureMigrationState> m_state;
+};
+
+}
+
+CaptureMigration::CaptureMigration(QObject *parent)
+    : QObject(parent)
+    , m_startTime(QDateTime::currentDateTime())
+    , m_interrupted(QFileInfo::exists(journalPath()))
+{
+    m_pool.setMaxThreadCount(2);
+
+    m_notifyTimer.setSingleShot(true);
+    m_notifyTimer.setInterval(0);
+    connect(&m_notifyTimer, &QTimer::timeout, this, &CaptureMigration::progressChanged);
+}
+
+CaptureMigration::~CaptureMigration()
+{
+    // The journal is kept so the migration is resumed when the camera is next started.
+    if (m_state) {
+        m_state->cancelled.store(1);
+    }
+    m_pool.waitForDone();
+}
+
+bool CaptureMigration::isRunning() const
+{
+    return m_running;
+}
+
+bool CaptureMigration::isInterrupted() const
+{
+    return m_interrupted;
+}
+
+int CaptureMigration::fileCount() const
+{
+    return m_fileCount;
+}
+
+int CaptureMigration::migratedCount() const
+{
+    return m_migratedCount;
+}
+
+int CaptureMigration::failedCount() const
+{
+    return m_failedCount;
+}
+
+qint64 CaptureMigration::bytesTotal() const
+{
+    return m_bytesTotal;
+}
+
+qint64 CaptureMigration::bytesMigrated() const
+{
+    return m_bytesMigrated;
+}
+
+int CaptureMigration::threadCount() const
+{
+    return m_pool.maxThreadCount();
+}
+
+// A couple of workers keep a card busy while one of them is waiting on the other storage, more
+// just compete for the same card.
+void CaptureMigration::setThreadCount(int count)
+{
+    m_pool.setMaxThreadCount(qBound(1, count, 8));
+}
+
+bool CaptureMigration::start(const QStringList &sourceDirectories, const QStringList &targetDirectories)
+{
+    if (m_running
+            || sourceDirectories.isEmpty()
+            || sourceDirectories.count() != targetDirectories.count()) {
+        return false;
+    }
+
+    for (int i = 0; i < sourceDirectories.count(); ++i) {
+        if (QDir::cleanPath(sourceDirectories.at(i)) == QDir::cleanPath(targetDirectories.at(i))) {
+            return false;
+        }
+    }
+
+    QSettings journal(journalPath(), QSettings::IniFormat);
+    journal.setValue(QStringLiteral("sourceDirectories"), sourceDirectories);
+    journal.setValue(QStringLiteral("targetDirectories"), targetDirectories);
+    journal.sync();
+
+    run(sourceDirectories, targetDirectories);
+
+    return true;
+}
+
+bool CaptureMigration::resume()
+{
+    if (m_running || !m_interrupted) {
+        return false;
+    }
+
+    const QSettings journal(journalPath(), QSettings::IniFormat);
+    const QStringList sourceDirectories = journal.value(QStringLiteral("sourceDirectories")).toStringList();
+    const QStringList targetDirectories = journal.value(QStringLiteral("targetDirectories")).toStringList();
+
+    if (sourceDirectories.isEmpty() || sourceDirectories.count() != targetDirectories.count()) {
+        QFile::remove(journalPath());
+        setInterrupted(false);
+        return false;
+    }
+
+    run(sourceDirectories, targetDirectories);
+
+    return true;
+}
+
+void CaptureMigration::cancel()
+{
+    if (m_running) {
+        m_state->cancelled.store(1);
+    }
+
+    QFile::remove(journalPath());
+    setInterrupted(false);
+}
+
+void CaptureMigration::run(const QStringList &sourceDirectories, const QStringList &targetDirectories)
+{
+    m_state = QSharedPointer<CaptureMigrationState>(new CaptureMigrationState);
+    m_fileCount = 0;
+    m_migratedCount = 0;
+    m_failedCount = 0;
+    m_bytesTotal = 0;
+    m_bytesMigrated = 0;
+    m_complete = false;
+    m_running = true;
+
+    setInterrupted(false);
+
+    ScanTask * const task = new ScanTask(m_state, sourceDirectories, targetDirectories, m_startTime);
+    connect(task, &ScanTask::scanned, this, &CaptureMigration::scanned);
+    m_pool.start(task);
+
+    emit runningChanged();
+    notify();
+}
+
+void CaptureMigration::scanned(int count, qint64 bytes, bool complete)
+{
+    m_fileCount = count;
+    m_bytesTotal = bytes;
+    m_complete = complete;
+
+    notify();
+
+    m_workers = qMax(1, qMin(count, m_pool.maxThreadCount()));
+    for (int i = 0; i < m_workers; ++i) {
+        MigrationWorker * const worker = new MigrationWorker(m_state);
+        connect(worker, &MigrationWorker::copied, this, &CaptureMigration::copied);
+        connect(worker, &MigrationWorker::migrated, this, &CaptureMigration::migrated);
+        connect(worker, &MigrationWorker::failed, this, &CaptureMigration::failed);
+        connect(worker, &MigrationWorker::finished, this, &CaptureMigration::workerFinished);
+        m_pool.start(worker);
+    }
+}
+
+void CaptureMigration::copied(qint64 bytes)
+{
+    m_bytesMigrated += bytes;
+
+    notify();
+}
+
+void CaptureMigration::migrated(const QUrl &url, const QUrl &movedUrl)
+{
+    m_migratedCount += 1;
+
+    notify();
+
+    emit captureMoved(url, movedUrl);
+}
+
+void CaptureMigration::failed(const QUrl &)
+{
+    m_failedCount += 1;
+
+    notify();
+}
+
+// Files which failed to copy are left where they were and the migration is finished anyway, it
+// isn't likely to go any better the next time.  If a storage wasn't available, or the camera
+// is exiting, the journal is kept so the rest can be migrated later.
+void CaptureMigration::workerFinished()
+{
+    if (--m_workers > 0) {
+        return;
+    }
+
+    const bool cancelled = m_state->cancelled.load() != 0;
+    m_running = false;
+
+    if (!cancelled && m_complete) {
+        QFile::remove(journalPath());
+    } else if (!cancelled) {
+        setInterrupted(true);
+    }
+
+    emit runningChanged();
+}
+
+void CaptureMigration::setInterrupted(bool interrupted)
+{
+    if (m_interrupted != interrupted) {
+        m_interrupted = interrupted;
+        emit interruptedChanged();
+    }
+}
+
+void CaptureMigration::notify()
+{
+    if (!m_notifyTimer.isActive()) {
+        m_notifyTimer.start();
+    }
+}
+
+QString CaptureMigration::journalPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/jolla-camera/migration.ini");
+}
+
+#include "capturemigration.moc"
@@ -0,0 +1,100 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef CAPTUREMIGRATION_H
+#define CAPTUREMIGRATION_H
+
+#include <QDateTime>
+#include <QObject>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <QUrl>
+
+struct CaptureMigrationState;
+
+// Moves the captures in a set of directories to another storage, for when the storage used by
+// the camera is changed.  The files are shared between a few workers, each of which copies a
+// file in the kernel, verifies the copy against the original once it has been synced and then
+// removes the original, so a capture is never lost if the migration is interrupted.  The
+// directories being migrated are recorded in a journal until every file has been moved, and an
+// interrupted migration is resumed by calling resume() when the camera is next started.  Files
+// already copied but not removed are recognized by their contents and aren't copied again.
+class CaptureMigration : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool running READ isRunning NOTIFY runningChanged)
+    Q_PROPERTY(bool interrupted READ isInterrupted NOTIFY interruptedChanged)
+    Q_PROPERTY(int fileCount READ fileCount NOTIFY progressChanged)
+    Q_PROPERTY(int migratedCount READ migratedCount NOTIFY progressChanged)
+    Q_PROPERTY(int failedCount READ failedCount NOTIFY progressChanged)
+    Q_PROPERTY(qint64 bytesTotal READ bytesTotal NOTIFY progressChanged)
+    Q_PROPERTY(qint64 bytesMigrated READ bytesMigrated NOTIFY progressChanged)
+
+public:
+    explicit CaptureMigration(QObject *parent = nullptr);
+    ~CaptureMigration() override;
+
+    bool isRunning() const;
+    bool isInterrupted() const;
+
+    int fileCount() const;
+    int migratedCount() const;
+    int failedCount() const;
+    qint64 bytesTotal() const;
+    qint64 bytesMigrated() const;
+
+    int threadCount() const;
+    void setThreadCount(int count);
+
+    // Moves the captures in each source directory, and the date subdirectories within it, to
+    // the target directory at the same index.
+    bool start(const QStringList &sourceDirectories, const QStringList &targetDirectories);
+
+    // Stops the migration after the files being copied.  The files already moved stay where they
+    // are and the migration isn't resumed.
+    Q_INVOKABLE void cancel();
+
+    // Restarts a migration which was interrupted by the camera exiting or a storage becoming
+    // unavailable.  Returns false if there is nothing to resume.
+    Q_INVOKABLE bool resume();
+
+signals:
+    void runningChanged();
+    void interruptedChanged();
+    void progressChanged();
+
+    // A capture has been moved to the target storage.
+    void captureMoved(const QUrl &url, const QUrl &movedUrl);
+
+private:
+    inline void run(const QStringList &sourceDirectories, const QStringList &targetDirectories);
+    inline void scanned(int count, qint64 bytes, bool complete);
+    inline void copied(qint64 bytes);
+    inline void migrated(const QUrl &url, const QUrl &movedUrl);
+    inline void failed(const QUrl &url);
+    inline void workerFinished();
+    inline void setInterrupted(bool interrupted);
+    inline void notify();
+    inline static QString journalPath();
+
+    QThreadPool m_pool;
+    QTimer m_notifyTimer;
+    QSharedPointer<CaptureMigrationState> m_state;
+    const QDateTime m_startTime;
+    int m_workers = 0;
+    int m_fileCount = 0;
+    int m_migratedCount = 0;
+    int m_failedCount = 0;
+    qint64 m_bytesTotal = 0;
+    qint64 m_bytesMigrated = 0;
+    bool m_running = false;
+    bool m_interrupted = false;
+    bool m_complete = false;    // every source and target directory was available
+};
+
+#endif
@@ -1,24 +1,36 @@
 // SPDX-FileCopyrightText: 2013 - 2021 Jolla Ltd.
-// SPDX-FileCopyrightText: 2025 Jolla Mobile Ltd
+// SPDX-FileCopyrightText: 2025 - 2026 Jolla Mobile Ltd
 //
 // SPDX-License-Identifier: BSD-3-Clause
 
 #include "capturemodel.h"
+#include "capturefilename.h"
+#include "captureindex.h"
+#include "capturethumbnailprovider.h"
+#include "capturetrace.h"
 
 #include <QCoreApplication>
 #include <QEvent>
 #include <QFile>
 #include <QFileInfo>
-#include <QMimeType>
 #include <QMutexLocker>
-#include <QRegularExpression>
 #include <QRunnable>
+#include <QSemaphore>
+#include <QStandardPaths>
+#include <QThread>
 #include <QThreadPool>
 #include <QUrl>
 
+#include <algorithm>
+#include <limits>
+
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -43,9 +55,88 @@ private:
     Function m_function;
 };
 
+// Captures may be filed in YYYY/MM subdirectories of a capture directory.  Returns the year or
+// month a subdirectory name represents for a directory at the given depth, or -1 if it isn't a
+// date subdirectory.
+int dateSubdirectoryNumber(const char *name, int depth)
+{
+    const int length = depth == 0 ? 4 : depth == 1 ? 2 : 0;
+    if (length == 0 || int(strlen(name)) != length) {
+        return -1;
+    }
+
+    int number = 0;
+    for (int i = 0; i < length; ++i) {
+        if (name[i] < '0' || name[i] > '9') {
+            return -1;
+        }
+        number = number * 10 + name[i] - '0';
+    }
+
+    return depth == 0 || (number >= 1 && number <= 12) ? number : -1;
+}
+
+QByteArray dateSubdirectoryPath(const QByteArray &parent, int depth, quint32 number)
+{
+    return parent + '/' + QByteArray::number(number).rightJustified(depth == 0 ? 4 : 2, '0');
+}
+
+template <class Function> void runAsync(QThreadPool *pool, const Function &function)
+{
+    pool->start(new AsyncFunction<Function>(function));
+}
+
 template <class Function> void runAsync(const Function &function)
 {
-    QThreadPool::globalInstance()->start(new AsyncFunction<Function>(function));
+    runAsync(QThreadPool::globalInstance(), function);
+}
+
+Q_GLOBAL_STATIC(QThreadPool, scanThreadPool)
+Q_GLOBAL_STATIC(QThreadPool, metadataThreadPool)
+
+// Merges runs of captures which are each sorted by compare into a single sorted list.
+template <class T, class Compare>
+QVector<T> mergeRuns(const QVector<QVector<T>> &runs, Compare compare)
+{
+    struct Cursor
+    {
+        const T *at;
+        const T *end;
+    };
+
+    QVector<Cursor> heap;
+    int count = 0;
+    for (const QVector<T> &run : runs) {
+        if (!run.isEmpty()) {
+            heap.append({ run.constBegin(), run.constEnd() });
+            count += run.count();
+        }
+    }
+
+    // The heap is ordered so the cursor with the capture which sorts first is at the front.
+    const auto heapCompare = [&](const Cursor &left, const Cursor &right) {
+        return compare(*right.at, *left.at);
+    };
+
+    std::make_heap(heap.begin(), heap.end(), heapCompare);
+
+    QVector<T> merged;
+    merged.reserve(count);
+
+    while (!heap.isEmpty()) {
+        std::pop_heap(heap.begin(), heap.end(), heapCompare);
+
+        Cursor &cursor = heap.last();
+        merged.append(*cursor.at);
+
+        if (++cursor.at != cursor.end) {
+            std::push_heap(heap.begin(), heap.end(), heapCompare);
+        } else {
+            heap.removeLast();
+        }
+    }
+
+    return merged;
 }
 
 class InvokableEvent : public QEvent
@@ -83,26 +174,91 @@ private:
 
 }
 
-QString CaptureModel::Capture::filePath() const
+// The state shared between the model and the tasks it runs on other threads.  A task may
+// outlive the model so it only communicates with it through this.
+struct CaptureModel::TaskState
 {
-    return QString::fromUtf8(directory + '/' + fileName);
-}
+    TaskState(CaptureModel *model, const QString &indexDirectory)
+        : model(model)
+        , indexDirectory(indexDirectory)
+    {
+    }
+
+    // A scan is cancelled when a newer one is started or the model is destroyed.
+    bool isCancelled(int scanGeneration) const
+    {
+        return generation.load() != scanGeneration;
+    }
+
+    bool isClosed()
+    {
+        QMutexLocker locker(&mutex);
+        return !model;
+    }
+
+    // Posts a function to be invoked by the model on its own thread, if it still exists.
+    template <class Function> void post(const Function &function)
+    {
+        QMutexLocker locker(&mutex);
+        if (model) {
+            QCoreApplication::postEvent(model, new FunctionEvent<Function>(function));
+        }
+    }
+
+    // The contents of the metadata cache file of a directory, which is read when it's first
+    // needed.  Only the metadata thread uses these.
+    QHash<quint64, CaptureMetadata> &metadataCache(const QByteArray &directory)
+    {
+        auto it = metadataCaches.find(directory);
+        if (it == metadataCaches.end()) {
+            it = metadataCaches.insert(directory, QHash<quint64, CaptureMetadata>());
+
+            const QString cachePath = CaptureMetadataCache::filePath(indexDirectory, directory);
+            if (!CaptureMetadataCache::read(cachePath, directory, &*it)) {
+                // Start a new cache file if the existing one can't be used.
+                it->clear();
+                QFile::remove(cachePath);
+            }
+        }
+        return *it;
+    }
+
+    QMutex mutex;
+    CaptureModel *model;
+    QAtomicInt generation { 0 };
+    const QString indexDirectory;
+    QHash<QByteArray, QHash<quint64, CaptureMetadata>> metadataCaches;
+};
 
 CaptureModel::CaptureModel(QObject *parent)
     : QAbstractListModel(parent)
+    , m_taskState(new TaskState(this, QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                + QLatin1String("/captures")))
 {
     connect(&m_notifier, &QSocketNotifier::activated, this, &CaptureModel::filesChanged);
+
+    m_batchTimer.setSingleShot(true);
+    m_batchTimer.setInterval(50);
+    connect(&m_batchTimer, &QTimer::timeout, this, &CaptureModel::applyPendingEvents);
+
+    // Collect the metadata requests made while the view is being laid out and read them together.
+    m_metadataTimer.setSingleShot(true);
+    m_metadataTimer.setInterval(0);
+    connect(&m_metadataTimer, &QTimer::timeout, this, &CaptureModel::requestMetadata);
+
+    // A single thread reads the metadata so a cache file is only accessed by one thread.
+    metadataThreadPool()->setMaxThreadCount(1);
 }
 
 CaptureModel::~CaptureModel()
 {
     close(m_inotifyFd);
 
-    QMutexLocker locker(&m_exitMutex);
-
-    if (m_scanning) {
-        m_exitCondition.wait(&m_exitMutex);
-    }
+    // Cancel any running scan and stop the remaining tasks from posting results back, there's no
+    // need to wait for them to finish.
+    QMutexLocker locker(&m_taskState->mutex);
+    m_taskState->model = nullptr;
+    m_taskState->generation.store(-1);
 }
 
 bool CaptureModel::isPopulated() const
@@ -126,9 +282,65 @@ void CaptureModel::setDirectories(const QStringList &directories)
     updateWatchedDirectories();
 }
 
+void CaptureModel::refreshDirectories()
+{
+    updateWatchedDirectories();
+}
+
+int CaptureModel::batchInterval() const
+{
+    return m_batchTimer.interval();
+}
+
+void CaptureModel::setBatchInterval(int interval)
+{
+    if (m_batchTimer.interval() != interval) {
+        m_batchTimer.setInterval(interval);
+
+        emit batchIntervalChanged();
+    }
+}
+
+CaptureModelStatistics *CaptureModel::statistics()
+{
+    return &m_statistics;
+}
+
+int CaptureModel::pageSize() const
+{
+    return m_pageSize;
+}
+
+void CaptureModel::setPageSize(int size)
+{
+    size = qMax(0, size);
+
+    if (m_pageSize != size) {
+        m_pageSize = size;
+        m_fetchLimit = size > 0 ? size : std::numeric_limits<int>::max();
+
+        if (m_exposedCount > m_fetchLimit) {
+            beginRemoveRows(QModelIndex(), m_fetchLimit, m_exposedCount - 1);
+            m_exposedCount = m_fetchLimit;
+            endRemoveRows();
+
+            emit countChanged();
+        } else if (fillPage()) {
+            emit countChanged();
+        }
+
+        emit pageSizeChanged();
+    }
+}
+
+quint64 CaptureModel::sortKey(int row) const
+{
+    return captureAt(row).key;
+}
+
 void CaptureModel::appendCapture(const QUrl &url, const QString &mimeType)
 {
-    if (m_notifier.isEnabled()) {
+    if (!m_scanning) {
         const QByteArray filePath = url.toLocalFile().toUtf8();
 
         const int index = filePath.lastIndexOf('/');
@@ -138,7 +350,7 @@ void CaptureModel::appendCapture(const QUrl &url, const QString &mimeType)
 
             for (const WatchedDirectory &directory : m_watchedDirectories) {
                 if (directory.path == directoryPath) {
-                    insertCapture(directory, fileName, mimeType);
+                    insertCapture(directory, fileName.constData(), mimeType);
 
                     return;
                 }
@@ -153,27 +365,83 @@ void CaptureModel::appendCapture(const QUrl &url, const QString &mimeType)
 
 void CaptureModel::deleteFile(int index)
 {
-    if (index >= 0 && index < count()) {
-        const Capture &capture = captureAt(index);
+    deleteFiles(QList<int>() << index);
+}
+
+void CaptureModel::deleteFiles(const QList<int> &indices)
+{
+    QVector<int> rows;
+    for (const int index : indices) {
+        if (index >= 0 && index < count()) {
+            rows.append(index);
+        }
+    }
+
+    if (rows.isEmpty()) {
+        return;
+    }
 
-        QFile::remove(capture.filePath());
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
 
-        if (m_notifier.isEnabled()) {
-            beginRemoveRows(QModelIndex(), index, index);
-            m_captures.removeAt(index);
-            m_maximumCaptureIndex -= 1;
-            endRemoveRows();
+    QVector<Capture> captures;
+    QVector<QByteArray> filePaths;
+    captures.reserve(rows.count());
+    filePaths.reserve(rows.count());
 
-            emit countChanged();
+    for (const int row : rows) {
+        const Capture capture = captureAt(row);
+        captures.append(capture);
+        filePaths.append(m_directoryPaths.at(capture.directory) + '/' + captureFileName(capture.key));
+    }
+
+    // The rows are removed straight away unless a scan is in progress, in which case the scan
+    // or the file events queued while it runs will remove them.  The file events for the files
+    // removed here are then expected and can be ignored.
+    const bool rowsRemoved = !m_scanning;
+    if (rowsRemoved) {
+        for (const Capture &capture : captures) {
+            m_deletedCaptures.insert(capture);
         }
+
+        removeCaptureRows(rows);
+        fillPage();
+
+        emit countChanged();
     }
+
+    // Unlinking can stall for some time on a removable card, so the files are removed by a
+    // worker thread.
+    const QSharedPointer<TaskState> state = m_taskState;
+
+    runAsync([state, captures, filePaths, rowsRemoved]() {
+        QVector<Capture> failed;
+
+        for (int i = 0; i < filePaths.count(); ++i) {
+            if (unlink(filePaths.at(i).constData()) != 0 && errno != ENOENT) {
+                failed.append(captures.at(i));
+            }
+        }
+
+        if (!failed.isEmpty()) {
+            state->post([state, failed, rowsRemoved]() {
+                state->model->deleteFailed(failed, rowsRemoved);
+            });
+        }
+    });
 }
 
 QHash<int, QByteArray> CaptureModel::roleNames() const
 {
     static const QHash<int, QByteArray> roleNames = {
         { Url, "url" },
-        { MimeType, "mimeType" }
+        { MimeType, "mimeType" },
+        { ThumbnailUrl, "thumbnailUrl" },
+        { CaptureTime, "captureTime" },
+        { FileSize, "fileSize" },
+        { Width, "width" },
+        { Height, "height" },
+        { Duration, "duration" }
     };
     return roleNames;
 }
@@ -190,6 +458,22 @@ int CaptureModel::rowCount(const QModelIndex &parent) const
     return !parent.isValid() ? count() : 0;
 }
 
+bool CaptureModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && m_exposedCount < captureCount();
+}
+
+void CaptureModel::fetchMore(const QModelIndex &parent)
+{
+    if (!parent.isValid() && m_pageSize > 0) {
+        m_fetchLimit = qMax(m_fetchLimit, m_exposedCount) + m_pageSize;
+
+        if (fillPage()) {
+            emit countChanged();
+        }
+    }
+}
+
 QVariant CaptureModel::data(const QModelIndex &index, int role) const
 {
     if (!index.isValid()) {
@@ -198,13 +482,40 @@ QVariant CaptureModel::data(const QModelIndex &index, int role) const
         const Capture &capture = captureAt(index.row());
         switch (role) {
         case Url:
-            return QUrl::fromLocalFile(capture.filePath());
+            return QUrl::fromLocalFile(filePath(capture));
         case MimeType:
-            if (capture.mimeType.isEmpty()) {
-                const_cast<Capture &>(capture).mimeType = m_mimeDatabase.mimeTypeForFile(
-                            capture.filePath()).name();
+            return m_mimeTypes.at(capture.mimeType);
+        case ThumbnailUrl:
+            if (capture.mimeType == JpegMimeType) {
+                QUrl url;
+                url.setScheme(QStringLiteral("image"));
+                url.setHost(CaptureThumbnailProvider::providerId());
+                url.setPath(filePath(capture));
+                return url;
+            } else {
+                // Videos are left to the system thumbnailer.
+                return QUrl();
+            }
+        case CaptureTime:
+            return captureDateTime(capture.key);
+        case FileSize:
+        case Width:
+        case Height:
+        case Duration: {
+            // Reading metadata which hasn't been cached yet queues a request for it.
+            const CaptureMetadata metadata = this->metadata(capture);
+            if (!metadata.isValid()) {
+                return QVariant();
+            } else if (role == FileSize) {
+                return metadata.fileSize;
+            } else if (role == Width) {
+                return metadata.width;
+            } else if (role == Height) {
+                return metadata.height;
+            } else {
+                return metadata.duration;
             }
-            return capture.mimeType;
+        }
         }
     }
     return QVariant();
@@ -213,6 +524,8 @@ QVariant CaptureModel::data(const QModelIndex &index, int role) const
 bool CaptureModel::event(QEvent *event)
 {
     if (event->type() == QEvent::User) {
+        m_statistics.addPostedEvent();
+
         static_cast<InvokableEvent *>(event)->invoke();
 
         return true;
@@ -234,10 +547,76 @@ void CaptureModel::componentComplete()
 }
 
 int CaptureModel::count() const
+{
+    return m_exposedCount;
+}
+
+int CaptureModel::captureCount() const
 {
     return m_maximumCaptureIndex + m_expiredCaptures.count() - m_minimumExpiredIndex;
 }
 
+int CaptureModel::beginInsertCaptures(int first, int count)
+{
+    // Rows inserted amongst the exposed rows are always shown, rows inserted after them are only
+    // shown if there are no hidden rows and the current page has room for them.
+    int visible = 0;
+    if (first < m_exposedCount) {
+        visible = count;
+    } else if (m_exposedCount == captureCount()) {
+        visible = qBound(0, m_fetchLimit - m_exposedCount, count);
+    }
+
+    m_statistics.addRowsInserted(count);
+
+    if (visible > 0) {
+        beginInsertRows(QModelIndex(), first, first + visible - 1);
+    }
+    return visible;
+}
+
+void CaptureModel::endInsertCaptures(int visible)
+{
+    if (visible > 0) {
+        m_exposedCount += visible;
+        endInsertRows();
+    }
+}
+
+int CaptureModel::beginRemoveCaptures(int first, int count)
+{
+    const int visible = qBound(0, m_exposedCount - first, count);
+
+    m_statistics.addRowsRemoved(count);
+
+    if (visible > 0) {
+        beginRemoveRows(QModelIndex(), first, first + visible - 1);
+    }
+    return visible;
+}
+
+void CaptureModel::endRemoveCaptures(int visible)
+{
+    if (visible > 0) {
+        m_exposedCount -= visible;
+        endRemoveRows();
+    }
+}
+
+bool CaptureModel::fillPage()
+{
+    const int target = qMin(captureCount(), m_fetchLimit);
+
+    if (m_exposedCount < target) {
+        beginInsertRows(QModelIndex(), m_exposedCount, target - 1);
+        m_exposedCount = target;
+        endInsertRows();
+
+        return true;
+    }
+    return false;
+}
+
 const CaptureModel::Capture &CaptureModel::captureAt(int index) const
 {
     return index < m_maximumCaptureIndex
@@ -245,14 +624,50 @@ const CaptureModel::Capture &CaptureModel::captureAt(int index) const
             : m_expiredCaptures.at(index - m_maximumCaptureIndex + m_minimumExpiredIndex);
 }
 
+QString CaptureModel::filePath(const Capture &capture) const
+{
+    return QString::fromUtf8(m_directoryPaths.at(capture.directory) + '/' + captureFileName(capture.key));
+}
+
+quint16 CaptureModel::directoryIndex(const QByteArray &path)
+{
+    // Directories keep their index for the lifetime of the model so captures can refer to them
+    // from the scan threads.
+    int index = m_directoryPaths.indexOf(path);
+    if (index == -1) {
+        index = m_directoryPaths.count();
+        m_directoryPaths.append(path);
+        m_metadata.resize(m_directoryPaths.count());
+    }
+    return index;
+}
+
+quint8 CaptureModel::mimeTypeIndex(const QString &mimeType)
+{
+    if (mimeType.isEmpty()) {
+        return 0;
+    }
+
+    int index = m_mimeTypes.indexOf(mimeType);
+    if (index == -1) {
+        if (m_mimeTypes.count() > std::numeric_limits<quint8>::max()) {
+            return 0;
+        }
+        index = m_mimeTypes.count();
+        m_mimeTypes.append(mimeType);
+    }
+    return index;
+}
+
 void CaptureModel::updateWatchedDirectories()
 {
-    if (!m_complete || !m_notifier.isEnabled()) {
+    if (!m_complete) {
         return;
     }
 
     QVector<QByteArray> addDirectories;
-    QVector<QByteArray> removeDirectories;
+    QVector<int> addDepths;
+    QVector<quint16> removeDirectories;
 
     for (const QString &directory : m_directories) {
         QFileInfo info(directory);
@@ -262,6 +677,29 @@ void CaptureModel::updateWatchedDirectories()
         const QByteArray canonicalPath = info.canonicalFilePath().toUtf8();
         if (!addDirectories.contains(canonicalPath)) {
             addDirectories.append(canonicalPath);
+            addDepths.append(0);
+        }
+    }
+
+    // Date subdirectories are watched for as long as they exist and their parent is watched.
+    // Sorting places each parent before its subdirectories.
+    std::sort(m_subdirectories.begin(), m_subdirectories.end());
+
+    for (auto it = m_subdirectories.begin(); it != m_subdirectories.end();) {
+        const int parent = addDirectories.indexOf(it->left(it->lastIndexOf('/')));
+
+        struct stat directoryStat;
+        if (parent != -1
+                && addDepths.at(parent) < 2
+                && stat(it->constData(), &directoryStat) == 0
+                && S_ISDIR(directoryStat.st_mode)) {
+            if (!addDirectories.contains(*it)) {
+                addDirectories.append(*it);
+                addDepths.append(addDepths.at(parent) + 1);
+            }
+            ++it;
+        } else {
+            it = m_subdirectories.erase(it);
         }
     }
 
@@ -269,237 +707,572 @@ void CaptureModel::updateWatchedDirectories()
         const int index = addDirectories.indexOf(it->path);
 
         if (index == -1) {
-            inotify_rm_watch(m_inotifyFd, it->id);
+            inotify_rm_watch(m_inotifyFd, it.key());
 
-            removeDirectories.append(it->path);
+            removeDirectories.append(it->directory);
 
             it = m_watchedDirectories.erase(it);
         } else {
             addDirectories.removeAt(index);
+            addDepths.removeAt(index);
 
             ++it;
         }
     }
 
-    const int watchFlags
-            = IN_DONT_FOLLOW
-            | IN_DELETE
-            | IN_MOVED_FROM
-            | IN_DELETE_SELF
-            | IN_MOVE_SELF
-            | IN_CREATE
-            | IN_MOVED_TO;
+    QVector<DirectoryScan> scans;
+
+    for (int i = 0; i < addDirectories.count(); ++i) {
+        watchDirectory(addDirectories.at(i), addDepths.at(i), &scans);
+    }
+
+    if (m_captures.isEmpty() && !scans.isEmpty()) {
+        // Publish the captures recorded by the directory indexes straight away, the scan will
+        // verify them against the directories and apply any differences.  The date
+        // subdirectories an index lists are watched and published in turn.
+        QVector<Capture> captures;
+        int indexedCount = 0;
+
+        for (int i = 0; i < scans.count(); ++i) {
+            DirectoryScan &scan = scans[i];
+
+            CaptureIndex index;
+            if (index.open(CaptureIndex::filePath(m_taskState->indexDirectory, scan.path), scan.path)) {
+                for (int j = 0; j < index.count(); ++j) {
+                    const Capture capture = {
+                        index.key(j), scan.directory, extensionMimeType(index.key(j))
+                    };
+                    captures.append(capture);
+                }
+                scan.indexed = true;
+                indexedCount += 1;
+
+                const QByteArray path = scan.path;
+                const int depth = scan.depth;
+
+                for (int j = 0; j < index.subdirectoryCount(); ++j) {
+                    const QByteArray subdirectory = dateSubdirectoryPath(
+                                path, depth, index.subdirectory(j));
+                    if (!m_subdirectories.contains(subdirectory)) {
+                        m_subdirectories.append(subdirectory);
+                        watchDirectory(subdirectory, depth + 1, &scans);
+                    }
+                }
+            }
+        }
 
-    for (auto it = addDirectories.begin(); it != addDirectories.end(); ) {
-        const QByteArray &directory = *it;
+        if (!captures.isEmpty()) {
+            std::sort(captures.begin(), captures.end(), compare);
 
-        const int wd = inotify_add_watch(m_inotifyFd, directory.constData(), watchFlags);
+            const int visible = beginInsertCaptures(0, captures.count());
+            m_captures = captures;
+            m_maximumCaptureIndex = captures.count();
+            endInsertCaptures(visible);
 
-        if (wd < 0) {
-            it = addDirectories.erase(it);
-        } else {
-            const WatchedDirectory watch { directory, wd };
-            m_watchedDirectories.append(watch);
-            ++it;
+            emit countChanged();
+        }
+
+        if (!m_populated && indexedCount == scans.count()) {
+            m_populated = true;
+
+            emit populatedChanged();
         }
     }
 
-    if (!addDirectories.isEmpty() || !removeDirectories.isEmpty()) {
+    if (!scans.isEmpty() || !removeDirectories.isEmpty()) {
+        // A scan which is still running is superseded by this one, its results are discarded
+        // and the directories it had yet to apply are carried over.
+        m_scanGeneration += 1;
+        m_taskState->generation.store(m_scanGeneration);
+        m_scanning = false;
+
+        for (const DirectoryScan &scan : m_unappliedScans) {
+            bool watched = false;
+            for (const WatchedDirectory &directory : m_watchedDirectories) {
+                watched |= directory.directory == scan.directory;
+            }
+            if (watched) {
+                scans.append(scan);
+            }
+        }
+        removeDirectories += m_unappliedRemovals;
+
+        m_unappliedScans = scans;
+        m_unappliedRemovals = removeDirectories;
+
+        // Bring the model up to date with any changes already reported before taking the
+        // snapshot the scan will be compared against.
+        applyPendingEvents();
+
+        const int scanThreads = m_scanThreads.value(0).toInt();
+        scanThreadPool()->setMaxThreadCount(scanThreads > 0 ? scanThreads : QThread::idealThreadCount());
+
         m_scanning = true;
-        m_notifier.setEnabled(false);
 
-        const QVector<Capture> originalCaptures = m_captures;
+        // The scan will account for any files removed by deleteFiles().
+        m_deletedCaptures.clear();
 
-        runAsync([this, originalCaptures, addDirectories, removeDirectories]() {
-            scanFiles(originalCaptures, addDirectories, removeDirectories);
+        const QSharedPointer<TaskState> state = m_taskState;
+        const int generation = m_scanGeneration;
+        const CaptureList<Capture> originalCaptures = m_captures;
+        const int pageSize = m_pageSize;
+
+        runAsync([state, generation, originalCaptures, scans, removeDirectories, pageSize]() {
+            scanFiles(state, generation, originalCaptures, scans, removeDirectories, pageSize);
         });
-    } else if (!m_populated) {
+    } else if (!m_populated && !m_scanning) {
         m_populated = true;
 
         emit populatedChanged();
     }
 }
 
-void CaptureModel::scanFiles(
-        const QVector<Capture> &originalCaptures,
-        const QVector<QByteArray> &addDirectories,
-        const QVector<QByteArray> &removeDirectories)
+void CaptureModel::watchDirectory(const QByteArray &path, int depth, QVector<DirectoryScan> *scans)
 {
-    bool removed = false;
+    const int watchFlags
+            = IN_DONT_FOLLOW
+            | IN_DELETE
+            | IN_MOVED_FROM
+            | IN_DELETE_SELF
+            | IN_MOVE_SELF
+            | IN_CREATE
+            | IN_CLOSE_WRITE
+            | IN_MOVED_TO;
 
-    QVector<Capture> captures = originalCaptures;
+    const int wd = inotify_add_watch(m_inotifyFd, path.constData(), watchFlags);
+    if (wd < 0) {
+        return;
+    }
 
-    if (!removeDirectories.isEmpty()) {
-        auto end = std::remove_if(captures.begin(), captures.end(), [&](const Capture &capture) {
-            return removeDirectories.contains(capture.directory);
-        });
-        if (end != captures.end()) {
-            captures.erase(end, captures.end());
+    const WatchedDirectory watch { path, directoryIndex(path), quint8(depth) };
+    m_watchedDirectories.insert(wd, watch);
 
-            removed = true;
-        }
-    }
+    DirectoryScan scan;
+    scan.path = path;
+    scan.directory = watch.directory;
+    scan.depth = watch.depth;
+    scans->append(scan);
+}
 
-    bool added = false;
+void CaptureModel::scanFiles(
+        const QSharedPointer<TaskState> &state,
+        int generation,
+        const CaptureList<Capture> &originalCaptures,
+        const QVector<DirectoryScan> &addDirectories,
+        const QVector<quint16> &removeDirectories,
+        int pageSize)
+{
+    const qint64 scanStart = CaptureTrace::timestamp();
 
-    const bool commonFiles = !captures.isEmpty();
+    // Each directory is read and sorted by its own task, the sorted results are then merged with
+    // the captures from the directories that remain.
+    QVector<DirectoryScan> scans = addDirectories;
+    QSemaphore finished;
 
-    for (const QByteArray &path : addDirectories) {
-        DIR *directory = opendir(path.constData());
-        if (!directory) {
-            continue;
-        }
+    for (DirectoryScan &scan : scans) {
+        DirectoryScan * const pointer = &scan;
 
-        while (struct dirent64 *entry = readdir64(directory)) {
-            if (entry->d_type != DT_REG) {
-                continue;
-            }
+        runAsync(scanThreadPool(), [&state, generation, pointer, pageSize, &finished]() {
+            const qint64 start = CaptureTrace::timestamp();
 
-            const QByteArray fileName(entry->d_name);
+            scanDirectory(*state, generation, pointer, pageSize);
 
-            if (!isCameraFile(fileName)) {
-                continue;
-            }
+            pointer->duration = CaptureTrace::timestamp() - start;
 
-            // do basic validation of file name to exclude things that didn't come from the camera.
-            if (fileName.startsWith('.')) {
-                continue;
+            if (CaptureTrace::isEnabled()) {
+                CaptureTrace::complete("scanDirectory", start, {
+                    { QStringLiteral("path"), QString::fromUtf8(pointer->path) },
+                    { QStringLiteral("entries"), pointer->entries },
+                    { QStringLiteral("rejected"), pointer->rejected }
+                });
             }
 
-            const Capture capture = { path, fileName, QString() };
+            finished.release();
+        });
+    }
 
-            captures.append(capture);
-            added = true;
-        }
+    finished.acquire(scans.count());
 
-        closedir(directory);
+    if (state->isCancelled(generation)) {
+        return;
     }
 
-    if (added) {
-        std::sort(captures.begin(), captures.end(), compare);
-    }
+    // The model is updated from the captures it currently holds.
+    CaptureList<Capture> publishedCaptures = originalCaptures;
+
+    if (pageSize > 0) {
+        // In paged mode each directory has only sorted its newest captures so far.  If the model
+        // is empty those are enough to show the first page straight away, the remainder is then
+        // sorted and appended to the model behind the page.
+        if (originalCaptures.isEmpty()) {
+            QVector<QVector<Capture>> heads;
+            for (const DirectoryScan &scan : scans) {
+                if (!scan.captures.isEmpty()) {
+                    heads.append(scan.captures.mid(0, pageSize));
+                }
+            }
 
-    if (added || removed) {
-        diffFiles(captures, originalCaptures, commonFiles);
-    } else {
-        post([this]() {
-            m_notifier.setEnabled(true);
+            QVector<Capture> page = mergeRuns(heads, compare);
+            page.resize(qMin(page.count(), pageSize));
 
-            if (!m_populated) {
-                m_populated = true;
+            if (!page.isEmpty()) {
+                publishedCaptures = page;
 
-                emit populatedChanged();
+                state->post([state, generation, page]() {
+                    state->model->publishPage(generation, page);
+                });
             }
-        });
-    }
+        }
 
-    QMutexLocker locker(&m_exitMutex);
-    m_scanning = false;
-    m_exitCondition.wakeOne();
+        int sorting = 0;
+        for (DirectoryScan &scan : scans) {
+            if (scan.captures.count() > pageSize) {
+                QVector<Capture> * const captures = &scan.captures;
+
+                runAsync(scanThreadPool(), [captures, pageSize, &finished]() {
+                    std::sort(captures->begin() + pageSize, captures->end(), compare);
+                    finished.release();
+                });
+                sorting += 1;
+            }
+        }
+
+        finished.acquire(sorting);
+
+        if (state->isCancelled(generation)) {
+            return;
+        }
+    }
+
+    QVector<quint16> expiredDirectories = removeDirectories;
+    QVector<QVector<Capture>> runs;
+
+    for (const DirectoryScan &scan : scans) {
+        if (scan.expired) {
+            expiredDirectories.append(scan.directory);
+        }
+        if (!scan.captures.isEmpty()) {
+            runs.append(scan.captures);
+        }
+    }
+
+    const bool added = !runs.isEmpty();
+    bool removed = false;
+
+    QVector<Capture> captures = originalCaptures.toVector();
+
+    if (!expiredDirectories.isEmpty()) {
+        auto end = std::remove_if(captures.begin(), captures.end(), [&](const Capture &capture) {
+            return expiredDirectories.contains(capture.directory);
+        });
+        if (end != captures.end()) {
+            captures.erase(end, captures.end());
+
+            removed = true;
+        }
+    }
+
+    if (added) {
+        runs.append(captures);
+        captures = mergeRuns(runs, compare);
+    }
+
+    const QVector<Change> changes = added || removed
+            ? diffFiles(captures, publishedCaptures)
+            : QVector<Change>();
+
+    QVector<QByteArray> subdirectories;
+    QVector<CaptureModelStatistics::DirectoryScan> statistics;
+    for (const DirectoryScan &scan : scans) {
+        for (const quint32 number : scan.subdirectories) {
+            subdirectories.append(dateSubdirectoryPath(scan.path, scan.depth, number));
+        }
+
+        CaptureModelStatistics::DirectoryScan directory;
+        directory.path = scan.path;
+        directory.duration = scan.duration;
+        directory.entries = scan.entries;
+        directory.rejected = scan.rejected;
+        directory.indexed = scan.upToDate;
+        statistics.append(directory);
+    }
+
+    if (CaptureTrace::isEnabled()) {
+        CaptureTrace::complete("scanFiles", scanStart, {
+            { QStringLiteral("directories"), scans.count() },
+            { QStringLiteral("captures"), captures.count() },
+            { QStringLiteral("changes"), changes.count() }
+        });
+    }
+
+    state->post([state, generation, captures, changes, subdirectories, statistics]() {
+        state->model->scanFinished(generation, captures, changes, subdirectories, statistics);
+    });
 }
 
-void CaptureModel::diffFiles(
-        const QVector<Capture> &captures, const QVector<Capture> &expired, const bool commonFiles)
+void CaptureModel::scanDirectory(
+        const TaskState &task, int generation, DirectoryScan *scan, int pageSize)
 {
-    post([this, captures]() {
-        m_expiredCaptures = m_captures;
-        m_captures = captures;
-        m_maximumCaptureIndex = 0;
-        m_minimumExpiredIndex = 0;
-    });
+    const QString indexPath = CaptureIndex::filePath(task.indexDirectory, scan->path);
+    const qint64 scanTime = CaptureIndex::currentTime();
 
-    int captureBegin = 0;
-    int expiredIndex = 0;
+    CaptureIndex::State state;
+    if (!CaptureIndex::readState(scan->path, &state)) {
+        scan->expired = scan->indexed;
+        return;
+    }
+
+    CaptureIndex index;
+    if (index.open(indexPath, scan->path) && index.isTrusted() && index.state() == state) {
+        // The directory hasn't been modified since the index was written, the captures and
+        // subdirectories it lists can be used as is.
+        scan->upToDate = true;
+
+        for (int i = 0; i < index.subdirectoryCount(); ++i) {
+            scan->subdirectories.append(index.subdirectory(i));
+        }
+
+        if (!scan->indexed) {
+            scan->captures.reserve(index.count());
+            for (int i = 0; i < index.count(); ++i) {
+                const Capture capture = {
+                    index.key(i), scan->directory, extensionMimeType(index.key(i))
+                };
+                scan->captures.append(capture);
+            }
+            sortCaptures(&scan->captures, pageSize);
+        }
+        return;
+    }
+    index.close();
 
-    for (int captureIndex = 0;
-            commonFiles && captureIndex < captures.count() && expiredIndex < expired.count();
-            ++captureIndex) {
-        const Capture capture = captures.at(captureIndex);
+    // If the index is out of date the captures it provided are replaced with the contents of the
+    // directory.
+    scan->expired = scan->indexed;
 
-        int expiredEnd = expiredIndex;
+    const int fd = open(scan->path.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    QVector<quint64> keys;
 
-        do {
-            if (capture != expired.at(expiredEnd)) {
-                ++expiredEnd;
+    // Read the directory entries in large batches, a readdir() buffer only holds a few entries
+    // which means a lot of system calls on a large directory.
+    alignas(struct dirent64) char buffer[32 * 1024];
+
+    for (;;) {
+        const long size = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (size <= 0) {
+            break;
+        }
+
+        // Give up between batches of entries if the scan has been superseded.
+        if (task.isCancelled(generation)) {
+            close(fd);
+            return;
+        }
+
+        for (long offset = 0; offset < size;) {
+            const struct dirent64 * const entry = reinterpret_cast<const struct dirent64 *>(
+                        buffer + offset);
+            offset += entry->d_reclen;
+
+            if (entry->d_type == DT_DIR) {
+                const int number = dateSubdirectoryNumber(entry->d_name, scan->depth);
+                if (number >= 0) {
+                    scan->subdirectories.append(number);
+                }
+                continue;
+            } else if (entry->d_type != DT_REG) {
                 continue;
             }
 
-            if (captureBegin != captureIndex || expiredEnd != expiredIndex) {
-                post([this, captureBegin, captureIndex, expiredIndex, expiredEnd]() {
-                    m_maximumCaptureIndex = captureBegin;
-                    m_minimumExpiredIndex = expiredIndex;
-
-                    if (expiredEnd > expiredIndex) {
-                        beginRemoveRows(
-                                    QModelIndex(),
-                                    m_maximumCaptureIndex,
-                                    m_maximumCaptureIndex + expiredEnd - expiredIndex - 1);
-                        m_minimumExpiredIndex = expiredEnd;
-                        endRemoveRows();
-                    }
+            scan->entries += 1;
 
-                    if (captureIndex > captureBegin) {
-                        beginInsertRows(
-                                    QModelIndex(),
-                                    m_maximumCaptureIndex,
-                                    m_maximumCaptureIndex + captureIndex - captureBegin - 1);
-                        m_maximumCaptureIndex = captureIndex;
-                        endInsertRows();
-                    }
-                    emit countChanged();
-                });
+            Capture capture = { 0, scan->directory, 0 };
+            if (!parseCaptureFileName(entry->d_name, &capture.key)) {
+                scan->rejected += 1;
+                continue;
             }
+            capture.mimeType = extensionMimeType(capture.key);
 
-            captureBegin = captureIndex + 1;
-            expiredIndex = expiredEnd + 1;
-            break;
-        } while (expiredEnd < expired.count());
+            scan->captures.append(capture);
+            keys.append(capture.key);
+        }
     }
 
-    post([this, captureBegin, expiredIndex]() {
-        m_maximumCaptureIndex = captureBegin;
-        m_minimumExpiredIndex = expiredIndex;
+    close(fd);
 
-        bool changed = false;
+    sortCaptures(&scan->captures, pageSize);
 
-        if (m_expiredCaptures.count() > expiredIndex) {
-            changed = true;
+    CaptureIndex::write(indexPath, scan->path, state, scanTime, keys, scan->subdirectories);
+}
 
-            beginRemoveRows(
-                        QModelIndex(),
-                        m_maximumCaptureIndex,
-                        m_maximumCaptureIndex + m_expiredCaptures.count() - expiredIndex - 1);
-            m_minimumExpiredIndex = m_expiredCaptures.count();
-            endRemoveRows();
+QVector<CaptureModel::Change> CaptureModel::diffFiles(
+        const QVector<Capture> &captures, const CaptureList<Capture> &expired)
+{
+    // Both lists are sorted by compare so a single pass over them finds each run of rows which
+    // differ between the two.  A run may remove rows, insert rows or replace some with others.
+    QVector<Change> changes;
+
+    const int captureCount = captures.count();
+    const int expiredCount = expired.count();
+
+    int captureIndex = 0;
+    int expiredIndex = 0;
+
+    while (captureIndex < captureCount || expiredIndex < expiredCount) {
+        if (captureIndex < captureCount
+                && expiredIndex < expiredCount
+                && captures.at(captureIndex) == expired.at(expiredIndex)) {
+            ++captureIndex;
+            ++expiredIndex;
+            continue;
         }
 
-        if (m_captures.count() > captureBegin) {
-            changed = true;
+        Change change = { captureIndex, captureIndex, expiredIndex, expiredIndex };
+
+        while (captureIndex < captureCount || expiredIndex < expiredCount) {
+            if (captureIndex == captureCount) {
+                ++expiredIndex;
+            } else if (expiredIndex == expiredCount) {
+                ++captureIndex;
+            } else if (captures.at(captureIndex) == expired.at(expiredIndex)) {
+                break;
+            } else if (compare(captures.at(captureIndex), expired.at(expiredIndex))) {
+                ++captureIndex;
+            } else {
+                ++expiredIndex;
+            }
+        }
 
-            beginInsertRows(
-                        QModelIndex(),
-                        m_maximumCaptureIndex,
-                        m_maximumCaptureIndex + m_captures.count() - captureBegin - 1);
-            m_maximumCaptureIndex = m_captures.count();
-            endInsertRows();
+        change.captureEnd = captureIndex;
+        change.expiredEnd = expiredIndex;
+        changes.append(change);
+    }
+
+    return changes;
+}
+
+void CaptureModel::publishPage(int generation, const QVector<Capture> &page)
+{
+    if (generation != m_scanGeneration) {
+        return;
+    }
+
+    const int visible = beginInsertCaptures(0, page.count());
+    m_captures = page;
+    m_maximumCaptureIndex = page.count();
+    endInsertCaptures(visible);
+
+    emit countChanged();
+
+    if (!m_populated) {
+        m_populated = true;
+
+        emit populatedChanged();
+    }
+}
+
+void CaptureModel::scanFinished(
+        int generation,
+        const QVector<Capture> &captures,
+        const QVector<Change> &changes,
+        const QVector<QByteArray> &subdirectories,
+        const QVector<CaptureModelStatistics::DirectoryScan> &statistics)
+{
+    if (generation != m_scanGeneration) {
+        // A newer scan has started since, it will apply its own results.
+        return;
+    }
+
+    const qint64 start = CaptureTrace::timestamp();
+
+    m_scanning = false;
+    m_unappliedScans.clear();
+    m_unappliedRemovals.clear();
+
+    if (!changes.isEmpty()) {
+        // Apply all of the changes at once.  Rows before the current change are read from the
+        // new list and rows after it from the old one, so the model stays consistent between
+        // each of the row signals.
+        m_expiredCaptures = m_captures;
+        m_captures = captures;
+        m_maximumCaptureIndex = 0;
+        m_minimumExpiredIndex = 0;
+
+        for (const Change &change : changes) {
+            m_maximumCaptureIndex = change.captureBegin;
+            m_minimumExpiredIndex = change.expiredBegin;
+
+            if (change.expiredEnd > change.expiredBegin) {
+                const int visible = beginRemoveCaptures(
+                            m_maximumCaptureIndex, change.expiredEnd - change.expiredBegin);
+                forgetMetadata(m_expiredCaptures.constBegin() + change.expiredBegin,
+                               m_expiredCaptures.constBegin() + change.expiredEnd);
+                m_minimumExpiredIndex = change.expiredEnd;
+                endRemoveCaptures(visible);
+            }
+
+            if (change.captureEnd > change.captureBegin) {
+                const int visible = beginInsertCaptures(
+                            m_maximumCaptureIndex, change.captureEnd - change.captureBegin);
+                m_maximumCaptureIndex = change.captureEnd;
+                endInsertCaptures(visible);
+            }
         }
 
         m_maximumCaptureIndex = m_captures.count();
         m_minimumExpiredIndex = 0;
         m_expiredCaptures.clear();
 
-        m_notifier.setEnabled(true);
+        fillPage();
 
-        if (changed) {
-            emit countChanged();
-        }
+        emit countChanged();
+    }
 
-        if (!m_populated) {
-            m_populated = true;
+    const qint64 applyTime = CaptureTrace::timestamp() - start;
 
-            emit populatedChanged();
+    m_statistics.addScan(statistics, applyTime);
+
+    if (CaptureTrace::isEnabled()) {
+        CaptureTrace::complete("applyScan", start, {
+            { QStringLiteral("changes"), changes.count() },
+            { QStringLiteral("captures"), captures.count() }
+        });
+
+        CaptureTrace::counter("captures", { { QStringLiteral("rows"), captureCount() } });
+    }
+
+    for (const CaptureModelStatistics::DirectoryScan &directory : statistics) {
+        qCDebug(lcCaptureModel) << "Scanned" << directory.path << "in" << directory.duration << "us,"
+                                << directory.entries << "entries," << directory.rejected << "rejected"
+                                << (directory.indexed ? "(index up to date)" : "");
+    }
+    qCDebug(lcCaptureModel) << "Applied" << changes.count() << "changes in" << applyTime << "us";
+
+    // Apply the file events which were received while the scan was running.
+    applyPendingEvents();
+
+    bool subdirectoriesFound = false;
+    for (const QByteArray &subdirectory : subdirectories) {
+        if (!m_subdirectories.contains(subdirectory)) {
+            m_subdirectories.append(subdirectory);
+            subdirectoriesFound = true;
         }
-    });
+    }
+
+    if (subdirectoriesFound) {
+        // Scan the new subdirectories, the model is populated once that has finished.
+        updateWatchedDirectories();
+    }
+
+    if (!m_populated && !m_scanning) {
+        m_populated = true;
+
+        emit populatedChanged();
+    }
 }
 
 void CaptureModel::filesChanged()
@@ -514,21 +1287,16 @@ void CaptureModel::filesChanged()
     char *at = buffer.data();
     char * const end = at + bufferSize;
 
+    int eventCount = 0;
+
     struct inotify_event *pevent = 0;
     for (;at < end; at += sizeof(inotify_event) + pevent->len) {
         pevent = reinterpret_cast<inotify_event *>(at);
 
-        const WatchedDirectory directory = [&]() -> WatchedDirectory {
-            for (const WatchedDirectory &directory : m_watchedDirectories) {
-                if (directory.id == pevent->wd) {
-                    return directory;
-                }
-            }
-            const WatchedDirectory directory = { QByteArray(), 0 };
-            return directory;
-        }();
+        ++eventCount;
 
-        if (directory.path.isEmpty()) {
+        const auto directory = m_watchedDirectories.constFind(pevent->wd);
+        if (directory == m_watchedDirectories.constEnd()) {
             continue;
         }
 
@@ -536,99 +1304,591 @@ void CaptureModel::filesChanged()
             directoriesChanged = true;
             continue;
         } else if (pevent->mask & IN_ISDIR) {
-            // Ignore directories.
+            // Watch new date subdirectories, removed ones report IN_DELETE_SELF or IN_MOVE_SELF
+            // through their own watch.
+            if ((pevent->mask & (IN_CREATE | IN_MOVED_TO))
+                    && pevent->len > 0
+                    && dateSubdirectoryNumber(pevent->name, directory->depth) >= 0) {
+                const QByteArray subdirectory = directory->path + '/' + pevent->name;
+                if (!m_subdirectories.contains(subdirectory)) {
+                    m_subdirectories.append(subdirectory);
+                    directoriesChanged = true;
+                }
+            }
             continue;
         } else if (pevent->len <= 0) {
             // No file name.
             continue;
         }
 
-        if (pevent->mask & (IN_DELETE | IN_MOVED_FROM)) {
-            const QByteArray fileName = QByteArray(pevent->name);
-
-            const Capture capture = { directory.path, fileName, QString() };
-
-            auto it = std::lower_bound(m_captures.begin(), m_captures.end(), capture, compare);
-            while (it != m_captures.end() && it->fileName == fileName) {
-                if (it->directory == directory.path) {
-                    int index = std::distance(m_captures.begin(), it);
+        Capture capture = { 0, directory->directory, 0 };
+        if (!parseCaptureFileName(pevent->name, &capture.key)) {
+            continue;
+        }
+        capture.mimeType = extensionMimeType(capture.key);
 
-                    beginRemoveRows(QModelIndex(), index, index);
-                    it = m_captures.erase(it);
-                    m_maximumCaptureIndex -= 1;
-                    endRemoveRows();
-                } else {
-                    ++it;
-                }
+        if (pevent->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            if (!m_deletedCaptures.remove(capture)) {
+                m_pendingEvents.append({ capture, false });
             }
         }
 
-        if (pevent->mask & (IN_CREATE | IN_MOVED_TO)) {
-            insertCapture(directory, QByteArray(pevent->name), QString());
+        // A file is added once it has been written rather than when it's created, so a capture
+        // isn't shown until it has been saved.
+        if (pevent->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+            m_pendingEvents.append({ capture, true });
         }
     }
 
+    m_statistics.addFileEvents(eventCount);
+
     if (directoriesChanged) {
+        applyPendingEvents();
         updateWatchedDirectories();
+    } else if (!m_pendingEvents.isEmpty() && !m_batchTimer.isActive() && !m_scanning) {
+        // Hold the events back for a short while so a burst of new files can be applied to the
+        // model as a few contiguous ranges rather than row by row.
+        m_batchTimer.start();
     }
 }
 
-void CaptureModel::insertCapture(
-        const WatchedDirectory &directory, const QByteArray &fileName, const QString &mimeType)
+void CaptureModel::applyPendingEvents()
 {
-    if (!isCameraFile(fileName)) {
+    m_batchTimer.stop();
+
+    // While a scan is running the events are held until its results have been applied.
+    if (m_pendingEvents.isEmpty() || m_scanning) {
         return;
     }
 
-    const Capture capture = { directory.path, fileName, mimeType };
+    const qint64 start = CaptureTrace::timestamp();
 
-    const auto insertAt = std::lower_bound(
-                m_captures.begin(), m_captures.end(), capture, compare);
+    QVector<FileEvent> events;
+    events.swap(m_pendingEvents);
 
-    bool duplicate = false;
-    for (auto it = insertAt; it != m_captures.end() && it->fileName == fileName; ++it) {
-        if (it->directory == directory.path) {
-            duplicate = true;
-            break;
+    // Group the events by file, preserving the order they arrived in so the last event for a file
+    // determines whether it exists.
+    std::stable_sort(events.begin(), events.end(), [](const FileEvent &left, const FileEvent &right) {
+        return compare(left.capture, right.capture);
+    });
+
+    QVector<int> removeRows;
+    QVector<Capture> newCaptures;
+
+    for (int i = 0; i < events.count(); ++i) {
+        const FileEvent &event = events.at(i);
+
+        if (i + 1 < events.count() && events.at(i + 1).capture == event.capture) {
+            continue;
+        }
+
+        const auto it = std::lower_bound(
+                    m_captures.constBegin(), m_captures.constEnd(), event.capture, compare);
+        const bool present = it != m_captures.constEnd() && *it == event.capture;
+
+        if (present && !event.exists) {
+            removeRows.append(std::distance(m_captures.constBegin(), it));
+        } else if (!present && event.exists) {
+            newCaptures.append(event.capture);
+        }
+    }
+
+    const int moved = moveCaptures(&removeRows, &newCaptures);
+
+    removeCaptureRows(removeRows);
+    insertCaptures(newCaptures);
+
+    if (!removeRows.isEmpty() || !newCaptures.isEmpty()) {
+        fillPage();
+
+        emit countChanged();
+    }
+
+    const qint64 applyTime = CaptureTrace::timestamp() - start;
+
+    m_statistics.addBatch(events.count(), applyTime);
+
+    if (CaptureTrace::isEnabled()) {
+        CaptureTrace::complete("applyEvents", start, {
+            { QStringLiteral("events"), events.count() },
+            { QStringLiteral("inserted"), newCaptures.count() },
+            { QStringLiteral("removed"), removeRows.count() },
+            { QStringLiteral("moved"), moved }
+        });
+
+        CaptureTrace::counter("captures", { { QStringLiteral("rows"), captureCount() } });
+    }
+
+    qCDebug(lcCaptureModel) << "Applied" << events.count() << "file events in" << applyTime << "us,"
+                            << newCaptures.count() << "inserted," << removeRows.count() << "removed,"
+                            << moved << "moved";
+}
+
+// A file which is removed from one directory and added to another in the same batch has been
+// moved by something which didn't report it with moveCapture().  The row is updated in place
+// rather than removed and inserted again.  Returns the number of captures moved, which are taken
+// from the rows to remove and the captures to insert.
+int CaptureModel::moveCaptures(QVector<int> *removeRows, QVector<Capture> *newCaptures)
+{
+    if (removeRows->isEmpty() || newCaptures->isEmpty()) {
+        return 0;
+    }
+
+    int moved = 0;
+
+    for (int i = 0; i < newCaptures->count();) {
+        const Capture capture = newCaptures->at(i);
+
+        // Rows with the same key are adjacent, the first sorts at or after the key with the
+        // lowest directory index.
+        const Capture first = { capture.key, 0, 0 };
+        int row = std::distance(m_captures.constBegin(), std::lower_bound(
+                    m_captures.constBegin(), m_captures.constEnd(), first, compare));
+
+        int removeIndex = -1;
+        for (; row < m_captures.count() && m_captures.at(row).key == capture.key; ++row) {
+            removeIndex = removeRows->indexOf(row);
+            if (removeIndex != -1) {
+                break;
+            }
+        }
+
+        if (removeIndex != -1 && replaceCapture(row, capture)) {
+            removeRows->remove(removeIndex);
+            newCaptures->remove(i);
+            ++moved;
+        } else {
+            ++i;
         }
     }
 
-    if (duplicate) {
+    return moved;
+}
+
+// Follows a capture which has been moved to another watched directory, as captures staged on
+// internal storage are when they're migrated to a memory card.  The row is updated in place
+// rather than removed and inserted again, so a view showing it isn't disturbed however the file
+// events for the move are batched.
+void CaptureModel::moveCapture(const QUrl &url, const QUrl &movedUrl)
+{
+    Capture capture;
+    Capture movedCapture;
+    if (m_scanning || !watchedCapture(url, &capture) || !watchedCapture(movedUrl, &movedCapture)) {
+        // The file events will update the model.
         return;
     }
 
-    int index = std::distance(m_captures.begin(), insertAt);
+    // The events for either file which haven't been applied yet are superseded by the move, and
+    // those still to be read find the model already up to date.
+    m_pendingEvents.erase(std::remove_if(
+                m_pendingEvents.begin(), m_pendingEvents.end(), [&](const FileEvent &event) {
+        return event.capture == capture || event.capture == movedCapture;
+    }), m_pendingEvents.end());
 
-    beginInsertRows(QModelIndex(), index, index);
-    m_captures.insert(insertAt, capture);
-    m_maximumCaptureIndex += 1;
-    endInsertRows();
+    const int row = captureRow(capture);
+    const bool moved = captureRow(movedCapture) != -1;
 
-    emit countChanged();
+    if (row != -1 && !moved && replaceCapture(row, movedCapture)) {
+        return;
+    }
+
+    QVector<int> removeRows;
+    QVector<Capture> newCaptures;
+    if (row != -1) {
+        removeRows.append(row);
+    }
+    if (!moved) {
+        newCaptures.append(movedCapture);
+    }
+
+    removeCaptureRows(removeRows);
+    insertCaptures(newCaptures);
+
+    if (!removeRows.isEmpty() || !newCaptures.isEmpty()) {
+        fillPage();
+
+        emit countChanged();
+    }
 }
 
-bool CaptureModel::compare(const Capture &left, const Capture &right)
+// Replaces the capture at a row with the same capture in another directory, if that doesn't
+// change the order of the rows.  The directory index sorts rows with the same key.
+bool CaptureModel::replaceCapture(int row, const Capture &capture)
+{
+    if ((row > 0 && !compare(m_captures.at(row - 1), capture))
+            || (row + 1 < m_captures.count() && !compare(capture, m_captures.at(row + 1)))) {
+        return false;
+    }
+
+    const Capture replaced = m_captures.at(row);
+    forgetMetadata(&replaced, &replaced + 1);
+
+    m_captures.replace(row, capture);
+
+    if (row < count()) {
+        const QModelIndex modelIndex = createIndex(row, 0);
+        emit dataChanged(modelIndex, modelIndex);
+    }
+
+    return true;
+}
+
+// Returns the row of a capture, or -1 if it isn't in the model.
+int CaptureModel::captureRow(const Capture &capture) const
+{
+    const auto it = std::lower_bound(m_captures.constBegin(), m_captures.constEnd(), capture, compare);
+    return it != m_captures.constEnd() && *it == capture
+            ? int(std::distance(m_captures.constBegin(), it))
+            : -1;
+}
+
+// Finds the capture a url refers to in a watched directory.
+bool CaptureModel::watchedCapture(const QUrl &url, Capture *capture) const
+{
+    const QByteArray filePath = url.toLocalFile().toUtf8();
+    const int index = filePath.lastIndexOf('/');
+    if (index == -1) {
+        return false;
+    }
+
+    const QByteArray directoryPath = filePath.mid(0, index);
+    for (const WatchedDirectory &directory : m_watchedDirectories) {
+        if (directory.path == directoryPath) {
+            *capture = { 0, directory.directory, 0 };
+            if (!parseCaptureFileName(filePath.constData() + index + 1, &capture->key)) {
+                return false;
+            }
+            capture->mimeType = extensionMimeType(capture->key);
+            return true;
+        }
+    }
+    return false;
+}
+
+CaptureMetadata CaptureModel::metadata(const Capture &capture) const
 {
-    return left.fileName > right.fileName;
+    QHash<quint64, CaptureMetadata> &metadata = m_metadata[capture.directory];
+
+    const auto it = metadata.constFind(capture.key);
+    if (it != metadata.constEnd()) {
+        return *it;
+    }
+
+    metadata.insert(capture.key, CaptureMetadata());
+
+    m_metadataRequests.append(capture);
+    m_metadataTimer.start();
+
+    return CaptureMetadata();
 }
 
-bool CaptureModel::isCameraFile(const QByteArray &fileName) const
+void CaptureModel::requestMetadata()
 {
-    static const QRegularExpression cameraFileRegEx = [] {
-        QRegularExpression regex("\\A\\d{8}_\\d{6}(?:_\\d+)?.(?:jpg|mp4)\\z");
+    // The captures removed since the last requests are dropped from the cache files first, in a
+    // single task for each directory.
+    QHash<quint16, QVector<quint64>> removals;
+    removals.swap(m_metadataRemovals);
+
+    for (auto it = removals.constBegin(); it != removals.constEnd(); ++it) {
+        const QSharedPointer<TaskState> state = m_taskState;
+        const QByteArray path = m_directoryPaths.at(it.key());
+        const QVector<quint64> keys = it.value();
+
+        runAsync(metadataThreadPool(), [state, path, keys]() {
+            removeCachedMetadata(state, path, keys);
+        });
+    }
+
+    QVector<Capture> requests;
+    requests.swap(m_metadataRequests);
 
-        regex.optimize();
+    std::stable_sort(requests.begin(), requests.end(), [](const Capture &left, const Capture &right) {
+        return left.directory < right.directory;
+    });
+
+    for (int begin = 0; begin < requests.count();) {
+        const quint16 directory = requests.at(begin).directory;
 
-        return regex;
-    }();
+        QVector<quint64> keys;
+        int end = begin;
+        for (; end < requests.count() && requests.at(end).directory == directory; ++end) {
+            keys.append(requests.at(end).key);
+        }
+        begin = end;
 
-    return cameraFileRegEx.match(QString::fromUtf8(fileName)).hasMatch();
+        const QByteArray path = m_directoryPaths.at(directory);
+        const QSharedPointer<TaskState> state = m_taskState;
+
+        runAsync(metadataThreadPool(), [state, path, directory, keys]() {
+            readMetadata(state, path, directory, keys);
+        });
+    }
 }
 
-template <class Function>
-void CaptureModel::post(const Function &function)
+void CaptureModel::readMetadata(
+        const QSharedPointer<TaskState> &state,
+        const QByteArray &path,
+        quint16 directory,
+        const QVector<quint64> &keys)
+{
+    QHash<quint64, CaptureMetadata> &cached = state->metadataCache(path);
+
+    // Deliver the results in batches so rows fill in progressively on a slow card.
+    const int batchSize = 32;
+
+    CaptureMetadataCache::Records records;
+    CaptureMetadataCache::Records read;
+
+    for (const quint64 key : keys) {
+        if (state->isClosed()) {
+            return;
+        }
+
+        const QByteArray filePath = path + '/' + captureFileName(key);
+
+        // A cached record is only used if the file hasn't been replaced since it was read.
+        CaptureMetadata metadata = cached.value(key);
+        if (!metadata.isValid() || !metadata.isCurrent(filePath)) {
+            metadata = CaptureMetadata();
+            CaptureMetadata::read(filePath, key & 1, &metadata);
+
+            if (metadata.isValid()) {
+                cached.insert(key, metadata);
+                read.append(qMakePair(key, metadata));
+            }
+        }
+
+        records.append(qMakePair(key, metadata));
+
+        if (records.count() == batchSize) {
+            state->post([state, directory, records]() {
+                state->model->metadataRead(directory, records);
+            });
+            records.clear();
+        }
+    }
+
+    if (!records.isEmpty()) {
+        state->post([state, directory, records]() {
+            state->model->metadataRead(directory, records);
+        });
+    }
+
+    if (!read.isEmpty()) {
+        CaptureMetadataCache::append(
+                    CaptureMetadataCache::filePath(state->indexDirectory, path), path, read);
+    }
+}
+
+void CaptureModel::metadataRead(quint16 directory, const CaptureMetadataCache::Records &records)
+{
+    QHash<quint64, CaptureMetadata> &metadata = m_metadata[directory];
+
+    QVector<int> rows;
+
+    for (const auto &record : records) {
+        auto it = metadata.find(record.first);
+        if (it == metadata.end()) {
+            // The capture was removed while its metadata was being read.
+            continue;
+        }
+        *it = record.second;
+
+        const Capture capture = { record.first, directory, 0 };
+        const auto row = std::lower_bound(
+                    m_captures.constBegin(), m_captures.constEnd(), capture, compare);
+        if (row != m_captures.constEnd() && *row == capture) {
+            const int index = std::distance(m_captures.constBegin(), row);
+            if (index < m_exposedCount) {
+                rows.append(index);
+            }
+        }
+    }
+
+    std::sort(rows.begin(), rows.end());
+
+    static const QVector<int> roles = { FileSize, Width, Height, Duration };
+
+    for (int begin = 0; begin < rows.count();) {
+        int end = begin + 1;
+        while (end < rows.count() && rows.at(end) == rows.at(end - 1) + 1) {
+            ++end;
+        }
+
+        emit dataChanged(createIndex(rows.at(begin), 0), createIndex(rows.at(end - 1), 0), roles);
+
+        begin = end;
+    }
+}
+
+// Drops the metadata of captures which have been removed from the model, both from memory and
+// from the cache files, so a new file given the same name is read again.
+void CaptureModel::forgetMetadata(const Capture *begin, const Capture *end)
+{
+    if (begin == end) {
+        return;
+    }
+
+    for (const Capture *capture = begin; capture != end; ++capture) {
+        m_metadata[capture->directory].remove(capture->key);
+        m_metadataRemovals[capture->directory].append(capture->key);
+    }
+
+    // Removals are sent to the metadata thread with the next requests.
+    m_metadataTimer.start();
+}
+
+void CaptureModel::removeCachedMetadata(
+        const QSharedPointer<TaskState> &state, const QByteArray &path, const QVector<quint64> &keys)
+{
+    QHash<quint64, CaptureMetadata> &cached = state->metadataCache(path);
+
+    // The cache is kept in memory once loaded so only the removal records are appended.  An
+    // invalid record removes a capture from the cache file, they're dropped when it's compacted.
+    CaptureMetadataCache::Records removed;
+    for (const quint64 key : keys) {
+        if (cached.remove(key) > 0) {
+            removed.append(qMakePair(key, CaptureMetadata()));
+        }
+    }
+
+    if (!removed.isEmpty()) {
+        CaptureMetadataCache::append(
+                    CaptureMetadataCache::filePath(state->indexDirectory, path), path, removed);
+    }
+}
+
+void CaptureModel::deleteFailed(const QVector<Capture> &captures, bool rowsRemoved)
+{
+    QList<QUrl> urls;
+    for (const Capture &capture : captures) {
+        urls.append(QUrl::fromLocalFile(filePath(capture)));
+    }
+
+    if (rowsRemoved) {
+        for (const Capture &capture : captures) {
+            m_deletedCaptures.remove(capture);
+        }
+
+        // Restore the rows of the files which still exist.  If a scan has started since, it will
+        // find them instead.
+        if (!m_scanning) {
+            QVector<Capture> restore;
+            for (const Capture &capture : captures) {
+                const auto it = std::lower_bound(
+                            m_captures.constBegin(), m_captures.constEnd(), capture, compare);
+                if (it == m_captures.constEnd() || *it != capture) {
+                    restore.append(capture);
+                }
+            }
+
+            if (!restore.isEmpty()) {
+                insertCaptures(restore);
+
+                emit countChanged();
+            }
+        }
+    }
+
+    emit deleteFilesFailed(urls);
+}
+
+void CaptureModel::removeCaptureRows(const QVector<int> &rows)
+{
+    // Remove contiguous ranges of rows starting from the end so the indices of the remaining
+    // ranges stay valid.
+    for (int end = rows.count(); end > 0;) {
+        int begin = end - 1;
+        while (begin > 0 && rows.at(begin - 1) == rows.at(begin) - 1) {
+            --begin;
+        }
+
+        const int first = rows.at(begin);
+        const int count = end - begin;
+
+        const int visible = beginRemoveCaptures(first, count);
+        forgetMetadata(m_captures.constBegin() + first, m_captures.constBegin() + first + count);
+        m_captures.remove(first, count);
+        m_maximumCaptureIndex -= count;
+        endRemoveCaptures(visible);
+
+        end = begin;
+    }
+}
+
+void CaptureModel::insertCaptures(const QVector<Capture> &captures)
+{
+    // Insert runs of new captures which sort between the same pair of existing rows together.
+    for (int begin = 0; begin < captures.count();) {
+        const int position = std::distance(m_captures.constBegin(), std::lower_bound(
+                    m_captures.constBegin(), m_captures.constEnd(), captures.at(begin), compare));
+
+        int end = begin + 1;
+        while (end < captures.count()
+               && (position == m_captures.count()
+                   || compare(captures.at(end), m_captures.at(position)))) {
+            ++end;
+        }
+
+        const int count = end - begin;
+
+        const int visible = beginInsertCaptures(position, count);
+        m_captures.insert(position, captures.constData() + begin, count);
+        m_maximumCaptureIndex += count;
+        endInsertCaptures(visible);
+
+        begin = end;
+    }
+}
+
+void CaptureModel::insertCapture(
+        const WatchedDirectory &directory, const char *fileName, const QString &mimeType)
+{
+    Capture capture = { 0, directory.directory, mimeTypeIndex(mimeType) };
+
+    if (!parseCaptureFileName(fileName, &capture.key)) {
+        return;
+    } else if (capture.mimeType == 0) {
+        capture.mimeType = extensionMimeType(capture.key);
+    }
+
+    const auto insertAt = std::lower_bound(
+                m_captures.constBegin(), m_captures.constEnd(), capture, compare);
+
+    if (insertAt != m_captures.constEnd() && *insertAt == capture) {
+        return;
+    }
+
+    int index = std::distance(m_captures.constBegin(), insertAt);
+
+    const int visible = beginInsertCaptures(index, 1);
+    m_captures.insert(index, capture);
+    m_maximumCaptureIndex += 1;
+    endInsertCaptures(visible);
+
+    emit countChanged();
+}
+
+void CaptureModel::sortCaptures(QVector<Capture> *captures, int pageSize)
+{
+    // In paged mode only the captures which may appear on the first page are sorted up front.
+    if (pageSize > 0 && pageSize < captures->count()) {
+        std::partial_sort(captures->begin(), captures->begin() + pageSize, captures->end(), compare);
+    } else {
+        std::sort(captures->begin(), captures->end(), compare);
+    }
+}
+
+quint8 CaptureModel::extensionMimeType(quint64 key)
+{
+    // Only jpg and mp4 files are accepted as captures so the extension is enough to identify
+    // the type without probing the file contents.
+    return key & 1 ? Mp4MimeType : JpegMimeType;
+}
+
+bool CaptureModel::compare(const Capture &left, const Capture &right)
 {
-    QCoreApplication::postEvent(this, new FunctionEvent<Function>(function));
+    return left.key > right.key || (left.key == right.key && left.directory < right.directory);
 }
 
 #include "moc_capturemodel.cpp"
@@ -1,6 +1,6 @@
 /*
  * SPDX-FileCopyrightText: 2013 - 2024 Jolla Ltd.
- * SPDX-FileCopyrightText: 2025 Jolla Mobile Ltd
+ * SPDX-FileCopyrightText: 2025 - 2026 Jolla Mobile Ltd
  *
  * SPDX-License-Identifier: BSD-3-Clause
  */
@@ -9,12 +9,22 @@
 #define CAPTUREMODEL_H
 
 #include <QAbstractItemModel>
-#include <QMimeDatabase>
+#include <QHash>
 #include <QMutex>
 #include <QQmlParserStatus>
+#include <QSet>
+#include <QSharedPointer>
 #include <QSocketNotifier>
+#include <QTimer>
 #include <QUrl>
-#include <QWaitCondition>
+
+#include <MDConfItem>
+
+#include "capturelist.h"
+#include "capturemetadata.h"
+#include "capturemodelstatistics.h"
+
+#include <limits>
 
 #include <sys/inotify.h>
 
@@ -25,11 +35,20 @@ class CaptureModel : public QAbstractListModel, public QQmlParserStatus
     Q_PROPERTY(bool populated READ isPopulated NOTIFY populatedChanged)
     Q_PROPERTY(QStringList directories READ directories WRITE setDirectories NOTIFY directoriesChanged)
     Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(int batchInterval READ batchInterval WRITE setBatchInterval NOTIFY batchIntervalChanged)
+    Q_PROPERTY(int pageSize READ pageSize WRITE setPageSize NOTIFY pageSizeChanged)
+    Q_PROPERTY(CaptureModelStatistics *stats READ statistics CONSTANT)
 
 public:
     enum {
         Url,
-        MimeType
+        MimeType,
+        ThumbnailUrl,
+        CaptureTime,
+        FileSize,
+        Width,
+        Height,
+        Duration
     };
 
     CaptureModel(QObject *parent = nullptr);
@@ -40,12 +59,31 @@ public:
     QStringList directories() const;
     void setDirectories(const QStringList &directories);
 
+    int batchInterval() const;
+    void setBatchInterval(int interval);
+
+    CaptureModelStatistics *statistics();
+
+    int pageSize() const;
+    void setPageSize(int size);
+
+    // The sort key of the capture at a row, see capturefilename.h.
+    quint64 sortKey(int row) const;
+
+    // Watches those of the directories which didn't exist when they were set and have been
+    // created since.
+    Q_INVOKABLE void refreshDirectories();
+
     Q_INVOKABLE void appendCapture(const QUrl &url, const QString &mimeType);
+    Q_INVOKABLE void moveCapture(const QUrl &url, const QUrl &movedUrl);
     Q_INVOKABLE void deleteFile(int index);
+    Q_INVOKABLE void deleteFiles(const QList<int> &indices);
 
     QHash<int, QByteArray> roleNames() const override;
     QModelIndex index(int row, int column, const QModelIndex &parent) const override;
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
     QVariant data(const QModelIndex &index, int role) const override;
 
     bool event(QEvent *event) override;
@@ -57,65 +95,178 @@ signals:
     void populatedChanged();
     void directoriesChanged();
     void countChanged();
+    void batchIntervalChanged();
+    void pageSizeChanged();
+    void deleteFilesFailed(const QList<QUrl> &urls);
 
 private:
+    // A capture is identified by the sort key decoded from its file name and the index of its
+    // directory in m_directoryPaths, the file name itself is formatted from the key on demand.
+    // See capturefilename.h for the layout of the key.
     struct Capture
     {
         bool operator ==(const Capture &other) const
         {
-            return directory == other.directory && fileName == other.fileName;
+            return key == other.key && directory == other.directory;
         }
         bool operator !=(const Capture &other) const
         {
-            return directory != other.directory || fileName != other.fileName;
+            return key != other.key || directory != other.directory;
         }
 
-        QString filePath() const;
+        friend uint qHash(const Capture &capture, uint seed = 0)
+        {
+            return qHash(capture.key, seed) ^ capture.directory;
+        }
 
-        QByteArray directory;
-        QByteArray fileName;
-        QString mimeType;
+        quint64 key;
+        quint16 directory;
+        quint8 mimeType;    // index in m_mimeTypes
+    };
 
+    enum : quint8 {
+        JpegMimeType = 1,
+        Mp4MimeType
     };
 
+    struct DirectoryScan
+    {
+        QByteArray path;
+        QVector<Capture> captures;
+        QVector<quint32> subdirectories;    // the date subdirectories found, by number
+        qint64 duration = 0;                // microseconds
+        int entries = 0;                    // files read from the directory
+        int rejected = 0;                   // files which weren't captures
+        quint16 directory = 0;
+        quint8 depth = 0;
+        bool indexed = false;
+        bool expired = false;
+        bool upToDate = false;              // the index was current and the directory wasn't read
+    };
+
+    // A watched directory is either one of the directories property or a date subdirectory of
+    // one, a year at depth 1 or a month within a year at depth 2.
     struct WatchedDirectory
     {
         QByteArray path;
-        qint64 id;
+        quint16 directory;
+        quint8 depth;
+    };
+
+    struct FileEvent
+    {
+        Capture capture;
+        bool exists;
+    };
+
+    // A run of rows which differ between two lists of captures.
+    struct Change
+    {
+        int captureBegin;
+        int captureEnd;
+        int expiredBegin;
+        int expiredEnd;
     };
 
+    struct TaskState;
+
     inline int count() const;
+    inline int captureCount() const;
+    inline int beginInsertCaptures(int first, int count);
+    inline void endInsertCaptures(int visible);
+    inline int beginRemoveCaptures(int first, int count);
+    inline void endRemoveCaptures(int visible);
+    inline bool fillPage();
     inline const Capture &captureAt(int index) const;
+    inline QString filePath(const Capture &capture) const;
+    inline quint16 directoryIndex(const QByteArray &path);
+    inline quint8 mimeTypeIndex(const QString &mimeType);
 
     inline void updateWatchedDirectories();
-    inline void scanFiles(
-            const QVector<Capture> &originalCaptures,
-            const QVector<QByteArray> &addDirectories,
-            const QVector<QByteArray> &removeDirectories);
-    inline void diffFiles(
-            const QVector<Capture> &captures, const QVector<Capture> &expired, bool commonFiles);
+    inline void watchDirectory(const QByteArray &path, int depth, QVector<DirectoryScan> *scans);
+    inline static void scanFiles(
+            const QSharedPointer<TaskState> &state,
+            int generation,
+            const CaptureList<Capture> &originalCaptures,
+            const QVector<DirectoryScan> &addDirectories,
+            const QVector<quint16> &removeDirectories,
+            int pageSize);
+    inline static void scanDirectory(
+            const TaskState &task, int generation, DirectoryScan *scan, int pageSize);
+    inline static QVector<Change> diffFiles(
+            const QVector<Capture> &captures, const CaptureList<Capture> &expired);
+    inline void publishPage(int generation, const QVector<Capture> &page);
+    inline void scanFinished(
+            int generation,
+            const QVector<Capture> &captures,
+            const QVector<Change> &changes,
+            const QVector<QByteArray> &subdirectories,
+            const QVector<CaptureModelStatistics::DirectoryScan> &statistics);
     inline void filesChanged();
+    inline void applyPendingEvents();
+    inline int moveCaptures(QVector<int> *removeRows, QVector<Capture> *newCaptures);
+    inline bool replaceCapture(int row, const Capture &capture);
+    inline int captureRow(const Capture &capture) const;
+    inline bool watchedCapture(const QUrl &url, Capture *capture) const;
 
+    inline CaptureMetadata metadata(const Capture &capture) const;
+    inline void requestMetadata();
+    inline static void readMetadata(
+            const QSharedPointer<TaskState> &state,
+            const QByteArray &path,
+            quint16 directory,
+            const QVector<quint64> &keys);
+    inline void metadataRead(quint16 directory, const CaptureMetadataCache::Records &records);
+    inline void forgetMetadata(const Capture *begin, const Capture *end);
+    inline static void removeCachedMetadata(
+            const QSharedPointer<TaskState> &state,
+            const QByteArray &path,
+            const QVector<quint64> &keys);
+
+    inline void deleteFailed(const QVector<Capture> &captures, bool rowsRemoved);
+    inline void removeCaptureRows(const QVector<int> &rows);
+    inline void insertCaptures(const QVector<Capture> &captures);
     inline void insertCapture(
-            const WatchedDirectory &directory, const QByteArray &fileName, const QString &mimeType);
+            const WatchedDirectory &directory, const char *fileName, const QString &mimeType);
+    inline static void sortCaptures(QVector<Capture> *captures, int pageSize);
+    inline static quint8 extensionMimeType(quint64 key);
     inline static bool compare(const Capture &left, const Capture &right);
-    inline bool isCameraFile(const QByteArray &fileName) const;
-
-    template <class Function> inline void post(const Function &function);
 
     QSocketNotifier m_notifier { inotify_init(), QSocketNotifier::Read };
-    QVector<Capture> m_captures;
-    QVector<Capture> m_expiredCaptures;
-    QVector<WatchedDirectory> m_watchedDirectories;
+    CaptureList<Capture> m_captures;
+    CaptureList<Capture> m_expiredCaptures;
+    QHash<int, WatchedDirectory> m_watchedDirectories;
+    QVector<QByteArray> m_subdirectories;   // the date subdirectories found so far
+    QVector<FileEvent> m_pendingEvents;
+    QTimer m_batchTimer;
+    CaptureModelStatistics m_statistics;
+    QVector<QByteArray> m_directoryPaths;
+    // The metadata read for each directory, indexed like m_directoryPaths.  An invalid entry
+    // marks a capture whose metadata has been requested.  Reading the data of a row requests
+    // the metadata it is missing, so these are updated by const functions.
+    mutable QVector<QHash<quint64, CaptureMetadata>> m_metadata;
+    mutable QVector<Capture> m_metadataRequests;
+    mutable QTimer m_metadataTimer;
+    QHash<quint16, QVector<quint64>> m_metadataRemovals;   // removed captures to drop from the cache files
+    QSet<Capture> m_deletedCaptures;
+    // The work of the running scan, which is carried over to its replacement if it is cancelled.
+    QVector<DirectoryScan> m_unappliedScans;
+    QVector<quint16> m_unappliedRemovals;
+    QSharedPointer<TaskState> m_taskState;
+    QStringList m_mimeTypes {
+        QString(), QStringLiteral("image/jpeg"), QStringLiteral("video/mp4")
+    };
     QStringList m_directories;
-    QWaitCondition m_exitCondition;
-    QMutex m_exitMutex;
-    QMimeDatabase m_mimeDatabase;
+    MDConfItem m_scanThreads { QStringLiteral("/apps/jolla-camera/captureScanThreads") };
     const QUrl m_fileUrl = QUrl::fromLocalFile(QLatin1String("/"));
     const int m_inotifyFd = m_notifier.socket();
     int m_maximumCaptureIndex = 0;
     int m_minimumExpiredIndex = 0;
+    int m_exposedCount = 0;
+    int m_pageSize = 0;
+    int m_fetchLimit = std::numeric_limits<int>::max();
     bool m_complete = true;
+    int m_scanGeneration = 0;
     bool m_scanning = false;
     bool m_populated = false;
 };
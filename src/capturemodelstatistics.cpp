@@ -0,0 +1,176 @@
+// SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "capturemodelstatistics.h"
+
+#include <QVariantMap>
+
+#include <algorithm>
+
+CaptureModelStatistics::CaptureModelStatistics(QObject *parent)
+    : QObject(parent)
+{
+    m_notifyTimer.setSingleShot(true);
+    m_notifyTimer.setInterval(0);
+    connect(&m_notifyTimer, &QTimer::timeout, this, &CaptureModelStatistics::changed);
+}
+
+CaptureModelStatistics::~CaptureModelStatistics()
+{
+}
+
+int CaptureModelStatistics::scans() const
+{
+    return m_scans;
+}
+
+QVariantList CaptureModelStatistics::directoryScans() const
+{
+    QVariantList scans;
+    for (const DirectoryScan &scan : m_directoryScans) {
+        QVariantMap map;
+        map.insert(QStringLiteral("path"), QString::fromUtf8(scan.path));
+        map.insert(QStringLiteral("duration"), scan.duration);
+        map.insert(QStringLiteral("entries"), scan.entries);
+        map.insert(QStringLiteral("rejected"), scan.rejected);
+        map.insert(QStringLiteral("indexed"), scan.indexed);
+        scans.append(map);
+    }
+    return scans;
+}
+
+qint64 CaptureModelStatistics::entriesRead() const
+{
+    return m_entriesRead;
+}
+
+qint64 CaptureModelStatistics::entriesRejected() const
+{
+    return m_entriesRejected;
+}
+
+qint64 CaptureModelStatistics::fileEvents() const
+{
+    return m_fileEvents;
+}
+
+int CaptureModelStatistics::batches() const
+{
+    return m_batches;
+}
+
+int CaptureModelStatistics::lastBatchEvents() const
+{
+    return m_lastBatchEvents;
+}
+
+int CaptureModelStatistics::largestBatchEvents() const
+{
+    return m_largestBatchEvents;
+}
+
+qint64 CaptureModelStatistics::rowsInserted() const
+{
+    return m_rowsInserted;
+}
+
+qint64 CaptureModelStatistics::rowsRemoved() const
+{
+    return m_rowsRemoved;
+}
+
+qint64 CaptureModelStatistics::applyTime() const
+{
+    return m_applyTime;
+}
+
+qint64 CaptureModelStatistics::postedEvents() const
+{
+    return m_postedEvents;
+}
+
+void CaptureModelStatistics::reset()
+{
+    m_directoryScans.clear();
+    m_entriesRead = 0;
+    m_entriesRejected = 0;
+    m_fileEvents = 0;
+    m_rowsInserted = 0;
+    m_rowsRemoved = 0;
+    m_applyTime = 0;
+    m_postedEvents = 0;
+    m_scans = 0;
+    m_batches = 0;
+    m_lastBatchEvents = 0;
+    m_largestBatchEvents = 0;
+
+    notify();
+}
+
+void CaptureModelStatistics::addScan(const QVector<DirectoryScan> &directories, qint64 applyTime)
+{
+    m_scans += 1;
+    m_applyTime += applyTime;
+
+    for (const DirectoryScan &directory : directories) {
+        m_entriesRead += directory.entries;
+        m_entriesRejected += directory.rejected;
+
+        auto it = std::find_if(m_directoryScans.begin(), m_directoryScans.end(), [&](const DirectoryScan &scan) {
+            return scan.path == directory.path;
+        });
+        if (it != m_directoryScans.end()) {
+            *it = directory;
+        } else {
+            m_directoryScans.append(directory);
+        }
+    }
+
+    notify();
+}
+
+void CaptureModelStatistics::addBatch(int events, qint64 applyTime)
+{
+    m_batches += 1;
+    m_lastBatchEvents = events;
+    m_largestBatchEvents = qMax(m_largestBatchEvents, events);
+    m_applyTime += applyTime;
+
+    notify();
+}
+
+void CaptureModelStatistics::addFileEvents(int events)
+{
+    m_fileEvents += events;
+
+    notify();
+}
+
+void CaptureModelStatistics::addRowsInserted(int count)
+{
+    m_rowsInserted += count;
+
+    notify();
+}
+
+void CaptureModelStatistics::addRowsRemoved(int count)
+{
+    m_rowsRemoved += count;
+
+    notify();
+}
+
+void CaptureModelStatistics::addPostedEvent()
+{
+    m_postedEvents += 1;
+
+    notify();
+}
+
+void CaptureModelStatistics::notify()
+{
+    if (!m_notifyTimer.isActive()) {
+        m_notifyTimer.start();
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef CAPTUREMODELSTATISTICS_H
+#define CAPTUREMODELSTATISTICS_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVariantList>
+#include <QVector>
+
+// Counters describing the work a CaptureModel has done, for finding out why a gallery is slow
+// without rebuilding it.  Durations are in microseconds.  The changed signal is coalesced so a
+// burst of updates notifies bindings once.
+class CaptureModelStatistics : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int scans READ scans NOTIFY changed)
+    Q_PROPERTY(QVariantList directoryScans READ directoryScans NOTIFY changed)
+    Q_PROPERTY(qint64 entriesRead READ entriesRead NOTIFY changed)
+    Q_PROPERTY(qint64 entriesRejected READ entriesRejected NOTIFY changed)
+    Q_PROPERTY(qint64 fileEvents READ fileEvents NOTIFY changed)
+    Q_PROPERTY(int batches READ batches NOTIFY changed)
+    Q_PROPERTY(int lastBatchEvents READ lastBatchEvents NOTIFY changed)
+    Q_PROPERTY(int largestBatchEvents READ largestBatchEvents NOTIFY changed)
+    Q_PROPERTY(qint64 rowsInserted READ rowsInserted NOTIFY changed)
+    Q_PROPERTY(qint64 rowsRemoved READ rowsRemoved NOTIFY changed)
+    Q_PROPERTY(qint64 applyTime READ applyTime NOTIFY changed)
+    Q_PROPERTY(qint64 postedEvents READ postedEvents NOTIFY changed)
+
+public:
+    // The result of the most recent scan of a directory.  A directory whose index was up to date
+    // reads no entries.
+    struct DirectoryScan
+    {
+        QByteArray path;
+        qint64 duration = 0;
+        int entries = 0;
+        int rejected = 0;
+        bool indexed = false;
+    };
+
+    explicit CaptureModelStatistics(QObject *parent = nullptr);
+    ~CaptureModelStatistics() override;
+
+    int scans() const;
+    QVariantList directoryScans() const;
+    qint64 entriesRead() const;
+    qint64 entriesRejected() const;
+    qint64 fileEvents() const;
+    int batches() const;
+    int lastBatchEvents() const;
+    int largestBatchEvents() const;
+    qint64 rowsInserted() const;
+    qint64 rowsRemoved() const;
+    qint64 applyTime() const;
+    qint64 postedEvents() const;
+
+    Q_INVOKABLE void reset();
+
+    void addScan(const QVector<DirectoryScan> &directories, qint64 applyTime);
+    void addBatch(int events, qint64 applyTime);
+    void addFileEvents(int events);
+    void addRowsInserted(int count);
+    void addRowsRemoved(int count);
+    void addPostedEvent();
+
+signals:
+    void changed();
+
+private:
+    void notify();
+
+    QTimer m_notifyTimer;
+    QVector<DirectoryScan> m_directoryScans;
+    qint64 m_entriesRead = 0;
+    qint64 m_entriesRejected = 0;
+    qint64 m_fileEvents = 0;
+    qint64 m_rowsInserted = 0;
+    qint64 m_rowsRemoved = 0;
+    qint64 m_applyTime = 0;
+    qint64 m_postedEvents = 0;
+    int m_scans = 0;
+    int m_batches = 0;
+    int m_lastBatchEvents = 0;
+    int m_largestBatchEvents = 0;
+};
+
+#endif
@@ -0,0 +1,406 @@
+// SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "capturesectionmodel.h"
+#include "capturefilename.h"
+#include "capturemodel.h"
+
+#include <algorithm>
+#include <limits>
+
+CaptureSectionModel::CaptureSectionModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+}
+
+CaptureSectionModel::~CaptureSectionModel()
+{
+}
+
+CaptureModel *CaptureSectionModel::captureModel() const
+{
+    return m_captureModel;
+}
+
+void CaptureSectionModel::setCaptureModel(CaptureModel *model)
+{
+    if (m_captureModel == model) {
+        return;
+    }
+
+    if (m_captureModel) {
+        disconnect(m_captureModel, nullptr, this, nullptr);
+    }
+
+    m_captureModel = model;
+
+    if (m_captureModel) {
+        connect(m_captureModel, &CaptureModel::rowsInserted,
+                this, &CaptureSectionModel::capturesInserted);
+        connect(m_captureModel, &CaptureModel::rowsAboutToBeRemoved,
+                this, &CaptureSectionModel::capturesAboutToBeRemoved);
+        connect(m_captureModel, &CaptureModel::modelReset,
+                this, &CaptureSectionModel::reset);
+    }
+
+    reset();
+
+    emit captureModelChanged();
+}
+
+CaptureSectionModel::Granularity CaptureSectionModel::granularity() const
+{
+    return m_granularity;
+}
+
+void CaptureSectionModel::setGranularity(Granularity granularity)
+{
+    if (m_granularity != granularity) {
+        const int previousCount = count();
+
+        beginResetModel();
+        m_granularity = granularity;
+        endResetModel();
+
+        emit granularityChanged();
+
+        if (count() != previousCount) {
+            emit countChanged();
+        }
+    }
+}
+
+int CaptureSectionModel::count() const
+{
+    return sections().count();
+}
+
+// Returns the first row captured on or before a date, or -1 if every row is newer.
+int CaptureSectionModel::rowForDate(const QDate &date) const
+{
+    if (!date.isValid()) {
+        return -1;
+    }
+
+    const int index = m_days.lowerBound(date.year() * 10000 + date.month() * 100 + date.day());
+
+    return index < m_days.count() ? m_days.firstRow(index) : -1;
+}
+
+// Returns the date of the section a row belongs to, the first of the month for Month sections.
+QDate CaptureSectionModel::dateForRow(int row) const
+{
+    const int section = sectionForRow(row);
+
+    return section != -1 ? keyDate(sections().key(section), m_granularity) : QDate();
+}
+
+int CaptureSectionModel::sectionForRow(int row) const
+{
+    return row >= 0 && row < m_days.total() ? sections().indexOfRow(row) : -1;
+}
+
+QHash<int, QByteArray> CaptureSectionModel::roleNames() const
+{
+    static const QHash<int, QByteArray> roleNames = {
+        { Date, "date" },
+        { Count, "count" },
+        { FirstRow, "firstRow" }
+    };
+    return roleNames;
+}
+
+int CaptureSectionModel::rowCount(const QModelIndex &parent) const
+{
+    return !parent.isValid() ? count() : 0;
+}
+
+QVariant CaptureSectionModel::data(const QModelIndex &index, int role) const
+{
+    const Buckets &buckets = sections();
+
+    if (index.row() >= 0 && index.row() < buckets.count()) {
+        switch (role) {
+        case Date:
+            return keyDate(buckets.key(index.row()), m_granularity);
+        case Count:
+            return buckets.captureCount(index.row());
+        case FirstRow:
+            return buckets.firstRow(index.row());
+        default:
+            break;
+        }
+    }
+    return QVariant();
+}
+
+void CaptureSectionModel::reset()
+{
+    const int previousCount = count();
+
+    beginResetModel();
+
+    m_days.clear();
+    m_months.clear();
+
+    if (m_captureModel) {
+        // The rows are sorted by date so each day is a single run of rows.
+        const int rows = m_captureModel->rowCount();
+        for (int row = 0; row < rows;) {
+            const int day = captureDateNumber(m_captureModel->sortKey(row));
+
+            int end = row + 1;
+            while (end < rows && captureDateNumber(m_captureModel->sortKey(end)) == day) {
+                ++end;
+            }
+
+            m_days.append(day, end - row);
+            m_months.append(day / 100, end - row);
+
+            row = end;
+        }
+    }
+
+    m_days.rebuild();
+    m_months.rebuild();
+
+    endResetModel();
+
+    if (count() != previousCount) {
+        emit countChanged();
+    }
+}
+
+void CaptureSectionModel::capturesInserted(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) {
+        return;
+    } else if (m_days.isEmpty()) {
+        // Build the sections in one pass when the capture model is first populated.
+        reset();
+    } else {
+        updateBuckets(first, last, 1);
+    }
+}
+
+void CaptureSectionModel::capturesAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) {
+        return;
+    } else if (first == 0 && last + 1 == m_days.total()) {
+        const int previousCount = count();
+
+        beginResetModel();
+        m_days.clear();
+        m_months.clear();
+        endResetModel();
+
+        if (previousCount != 0) {
+            emit countChanged();
+        }
+    } else {
+        updateBuckets(first, last, -1);
+    }
+}
+
+void CaptureSectionModel::updateBuckets(int first, int last, int sign)
+{
+    const int previousCount = count();
+    int firstChanged = std::numeric_limits<int>::max();
+
+    for (int row = first; row <= last;) {
+        const int day = captureDateNumber(m_captureModel->sortKey(row));
+
+        int end = row + 1;
+        while (end <= last && captureDateNumber(m_captureModel->sortKey(end)) == day) {
+            ++end;
+        }
+
+        const int count = sign * (end - row);
+
+        firstChanged = qMin(firstChanged, updateBucket(&m_days, m_granularity == Day, day, count));
+        firstChanged = qMin(firstChanged, updateBucket(&m_months, m_granularity == Month, day / 100, count));
+
+        row = end;
+    }
+
+    // The first row of every section after a change moves.
+    const int sectionCount = count();
+    if (firstChanged < sectionCount) {
+        emit dataChanged(index(firstChanged), index(sectionCount - 1), { Count, FirstRow });
+    }
+
+    if (sectionCount != previousCount) {
+        emit countChanged();
+    }
+}
+
+// Adds count captures to the bucket for key, creating or removing the bucket as required.
+// Returns the index of the bucket if it is one of the listed sections.
+int CaptureSectionModel::updateBucket(Buckets *buckets, bool active, int key, int count)
+{
+    const int index = buckets->lowerBound(key);
+
+    if (index == buckets->count() || buckets->key(index) != key) {
+        if (active) {
+            beginInsertRows(QModelIndex(), index, index);
+        }
+        buckets->insert(index, key, count);
+        if (active) {
+            endInsertRows();
+        }
+    } else if (buckets->captureCount(index) + count <= 0) {
+        if (active) {
+            beginRemoveRows(QModelIndex(), index, index);
+        }
+        buckets->remove(index);
+        if (active) {
+            endRemoveRows();
+        }
+    } else {
+        buckets->add(index, count);
+    }
+
+    return active ? index : std::numeric_limits<int>::max();
+}
+
+const CaptureSectionModel::Buckets &CaptureSectionModel::sections() const
+{
+    return m_granularity == Day ? m_days : m_months;
+}
+
+QDate CaptureSectionModel::keyDate(int key, Granularity granularity)
+{
+    return granularity == Day
+            ? QDate(key / 10000, key / 100 % 100, key % 100)
+            : QDate(key / 100, key % 100, 1);
+}
+
+int CaptureSectionModel::Buckets::count() const
+{
+    return m_keys.count();
+}
+
+bool CaptureSectionModel::Buckets::isEmpty() const
+{
+    return m_keys.isEmpty();
+}
+
+int CaptureSectionModel::Buckets::total() const
+{
+    return m_total;
+}
+
+int CaptureSectionModel::Buckets::key(int index) const
+{
+    return m_keys.at(index);
+}
+
+int CaptureSectionModel::Buckets::captureCount(int index) const
+{
+    return m_counts.at(index);
+}
+
+// Returns the index of the first bucket with a key less than or equal to key.
+int CaptureSectionModel::Buckets::lowerBound(int key) const
+{
+    return std::lower_bound(m_keys.constBegin(), m_keys.constEnd(), key, [](int left, int right) {
+        return left > right;
+    }) - m_keys.constBegin();
+}
+
+// Returns the sum of the counts of the buckets before index.
+int CaptureSectionModel::Buckets::firstRow(int index) const
+{
+    int row = 0;
+    for (int i = index; i > 0; i -= i & -i) {
+        row += m_tree.at(i);
+    }
+    return row;
+}
+
+// Returns the index of the bucket containing row, which is the largest index whose first row is
+// less than or equal to it.
+int CaptureSectionModel::Buckets::indexOfRow(int row) const
+{
+    const int size = m_keys.count();
+
+    int step = 1;
+    while (step * 2 <= size) {
+        step *= 2;
+    }
+
+    int index = 0;
+    for (; step > 0; step /= 2) {
+        if (index + step <= size && m_tree.at(index + step) <= row) {
+            index += step;
+            row -= m_tree.at(index);
+        }
+    }
+    return index;
+}
+
+void CaptureSectionModel::Buckets::append(int key, int count)
+{
+    if (!m_keys.isEmpty() && m_keys.last() == key) {
+        m_counts.last() += count;
+    } else {
+        m_keys.append(key);
+        m_counts.append(count);
+    }
+}
+
+void CaptureSectionModel::Buckets::insert(int index, int key, int count)
+{
+    m_keys.insert(index, key);
+    m_counts.insert(index, count);
+
+    rebuild();
+}
+
+void CaptureSectionModel::Buckets::remove(int index)
+{
+    m_keys.remove(index);
+    m_counts.remove(index);
+
+    rebuild();
+}
+
+void CaptureSectionModel::Buckets::add(int index, int count)
+{
+    m_counts[index] += count;
+    m_total += count;
+
+    for (int i = index + 1; i < m_tree.count(); i += i & -i) {
+        m_tree[i] += count;
+    }
+}
+
+void CaptureSectionModel::Buckets::clear()
+{
+    m_keys.clear();
+    m_counts.clear();
+    m_tree.clear();
+    m_total = 0;
+}
+
+// Builds the tree in linear time.  A new bucket is only needed on the first capture of a day so
+// the tree is rebuilt rather than shifted in place.
+void CaptureSectionModel::Buckets::rebuild()
+{
+    const int size = m_counts.count();
+
+    m_tree.fill(0, size + 1);
+    m_total = 0;
+
+    for (int i = 1; i <= size; ++i) {
+        m_tree[i] += m_counts.at(i - 1);
+        m_total += m_counts.at(i - 1);
+
+        const int parent = i + (i & -i);
+        if (parent <= size) {
+            m_tree[parent] += m_tree.at(i);
+        }
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef CAPTURESECTIONMODEL_H
+#define CAPTURESECTIONMODEL_H
+
+#include <QAbstractListModel>
+#include <QDate>
+#include <QPointer>
+#include <QVector>
+
+class CaptureModel;
+
+// Lists the days or months the rows of a CaptureModel were captured in, along with the number of
+// rows in each and the row each starts at.  The counts are kept in a Fenwick tree updated as rows
+// are inserted and removed, so mapping between rows and dates takes O(log n) time and a view
+// can jump to a date without walking the capture model.
+class CaptureSectionModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(CaptureModel *captureModel READ captureModel WRITE setCaptureModel NOTIFY captureModelChanged)
+    Q_PROPERTY(Granularity granularity READ granularity WRITE setGranularity NOTIFY granularityChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_ENUMS(Granularity)
+
+public:
+    enum Granularity {
+        Day,
+        Month
+    };
+
+    enum {
+        Date,
+        Count,
+        FirstRow
+    };
+
+    CaptureSectionModel(QObject *parent = nullptr);
+    ~CaptureSectionModel() override;
+
+    CaptureModel *captureModel() const;
+    void setCaptureModel(CaptureModel *model);
+
+    Granularity granularity() const;
+    void setGranularity(Granularity granularity);
+
+    int count() const;
+
+    Q_INVOKABLE int rowForDate(const QDate &date) const;
+    Q_INVOKABLE QDate dateForRow(int row) const;
+    Q_INVOKABLE int sectionForRow(int row) const;
+
+    QHash<int, QByteArray> roleNames() const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+
+signals:
+    void captureModelChanged();
+    void granularityChanged();
+    void countChanged();
+
+private:
+    // The number of captures for each day or month, in the descending order of the capture model.
+    // A key is a date as the decimal number yyyyMMdd, or yyyyMM for a month.
+    class Buckets
+    {
+    public:
+        inline int count() const;
+        inline bool isEmpty() const;
+        inline int total() const;
+        inline int key(int index) const;
+        inline int captureCount(int index) const;
+        inline int lowerBound(int key) const;
+        inline int firstRow(int index) const;
+        inline int indexOfRow(int row) const;
+
+        inline void append(int key, int count);
+        inline void insert(int index, int key, int count);
+        inline void remove(int index);
+        inline void add(int index, int count);
+        inline void clear();
+        inline void rebuild();
+
+    private:
+        QVector<int> m_keys;
+        QVector<int> m_counts;
+        QVector<int> m_tree;    // 1 based Fenwick tree of m_counts
+        int m_total = 0;
+    };
+
+    inline void reset();
+    inline void capturesInserted(const QModelIndex &parent, int first, int last);
+    inline void capturesAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    inline void updateBuckets(int first, int last, int sign);
+    inline int updateBucket(Buckets *buckets, bool active, int key, int count);
+    inline const Buckets &sections() const;
+    inline static QDate keyDate(int key, Granularity granularity);
+
+    QPointer<CaptureModel> m_captureModel;
+    Buckets m_days;
+    Buckets m_months;
+    Granularity m_granularity = Day;
+};
+
+#endif
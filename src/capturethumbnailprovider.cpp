@@ -0,0 +1,339 @@
+// SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "capturethumbnailprovider.h"
+#include "capturemetadata.h"
+
+#include <QAtomicInt>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSharedPointer>
+#include <QStandardPaths>
+#include <QTransform>
+#include <QUrl>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+
+namespace {
+
+// Thumbnails are cached at a few fixed sizes, a request is served from the smallest which
+// covers it.
+const int minimumThumbnailSize = 128;
+const int defaultThumbnailSize = 512;
+const int maximumThumbnailSize = 1024;
+
+// The cache directory is pruned to three quarters of its maximum size once it grows past it,
+// checking its size each time a few megabytes of thumbnails have been written.
+const qint64 maximumCacheSize = 64 * 1024 * 1024;
+const qint64 prunedCacheSize = maximumCacheSize / 4 * 3;
+const qint64 pruneInterval = 4 * 1024 * 1024;
+
+// The use time of a cached thumbnail is its modification time, which is refreshed when a
+// thumbnail which hasn't been used for a day is read again.
+const time_t touchInterval = 24 * 60 * 60;
+
+int thumbnailBucket(const QSize &requestedSize)
+{
+    int requested = qMax(requestedSize.width(), requestedSize.height());
+    if (requested <= 0) {
+        requested = defaultThumbnailSize;
+    }
+
+    int size = minimumThumbnailSize;
+    while (size < requested && size < maximumThumbnailSize) {
+        size *= 2;
+    }
+    return size;
+}
+
+QImage applyOrientation(const QImage &image, int orientation)
+{
+    QTransform transform;
+    switch (orientation) {
+    case 2: transform.scale(-1, 1); break;
+    case 3: transform.rotate(180); break;
+    case 4: transform.scale(1, -1); break;
+    case 5: transform.rotate(90); transform.scale(-1, 1); break;
+    case 6: transform.rotate(90); break;
+    case 7: transform.rotate(-90); transform.scale(-1, 1); break;
+    case 8: transform.rotate(-90); break;
+    default: return image;
+    }
+    return image.transformed(transform);
+}
+
+}
+
+struct CaptureThumbnailCache
+{
+    explicit CaptureThumbnailCache(const QString &directory)
+        : directory(directory)
+    {
+    }
+
+    // Accounts for a thumbnail written to the directory and returns whether it's due for pruning.
+    bool written(qint64 size)
+    {
+        QMutexLocker locker(&mutex);
+        bytesWritten += size;
+        if (bytesWritten < pruneInterval || pruning) {
+            return false;
+        }
+        bytesWritten = 0;
+        pruning = true;
+        return true;
+    }
+
+    // Removes the least recently used thumbnails if the directory is larger than its limit.
+    void prune()
+    {
+        const QFileInfoList files = QDir(directory).entryInfoList(
+                    QStringList() << QStringLiteral("*.jpg"), QDir::Files, QDir::Time);
+
+        qint64 size = 0;
+        for (const QFileInfo &file : files) {
+            size += file.size();
+        }
+
+        if (size > maximumCacheSize) {
+            // Files are listed from the most recently used, keep those which fit in the pruned size.
+            size = 0;
+            for (const QFileInfo &file : files) {
+                size += file.size();
+                if (size > prunedCacheSize) {
+                    QFile::remove(file.filePath());
+                }
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        pruning = false;
+    }
+
+    const QString directory;
+    QMutex mutex;
+    // The directory is checked after the first thumbnail written, in case an earlier run left it
+    // too large.
+    qint64 bytesWritten = pruneInterval;
+    bool pruning = false;
+};
+
+namespace {
+
+class ThumbnailResponse : public QQuickImageResponse
+{
+    Q_OBJECT
+public:
+    ThumbnailResponse()
+        : m_cancelled(new QAtomicInt(0))
+    {
+    }
+
+    QQuickTextureFactory *textureFactory() const override
+    {
+        return QQuickTextureFactory::textureFactoryForImage(m_image);
+    }
+
+    QString errorString() const override
+    {
+        return m_errorString;
+    }
+
+    void cancel() override
+    {
+        m_cancelled->store(1);
+    }
+
+    void complete(const QImage &image, const QString &errorString)
+    {
+        m_image = image;
+        m_errorString = errorString;
+
+        emit finished();
+    }
+
+    const QSharedPointer<QAtomicInt> m_cancelled;
+
+private:
+    QImage m_image;
+    QString m_errorString;
+};
+
+class ThumbnailJob : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    ThumbnailJob(
+            const QSharedPointer<QAtomicInt> &cancelled,
+            const QString &filePath,
+            const QSize &requestedSize,
+            const QSharedPointer<CaptureThumbnailCache> &cache)
+        : m_cancelled(cancelled)
+        , m_filePath(filePath)
+        , m_cache(cache)
+        , m_requestedSize(requestedSize)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        QString errorString;
+        QImage image;
+
+        if (!m_cancelled->load()) {
+            image = thumbnail(&errorString);
+
+            if (!image.isNull() && m_requestedSize.isValid()) {
+                const QSize size = image.size().scaled(m_requestedSize, Qt::KeepAspectRatioByExpanding);
+                if (size.width() < image.width()) {
+                    image = image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+                }
+            }
+        }
+
+        emit done(image, errorString);
+    }
+
+signals:
+    void done(const QImage &image, const QString &errorString);
+
+private:
+    QImage thumbnail(QString *errorString) const
+    {
+        struct stat fileStat;
+        if (stat(QFile::encodeName(m_filePath).constData(), &fileStat) != 0) {
+            *errorString = QStringLiteral("Cannot read %1").arg(m_filePath);
+            return QImage();
+        }
+
+        const int bucket = thumbnailBucket(m_requestedSize);
+
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(QFile::encodeName(m_filePath));
+        hash.addData(QByteArray::number(qint64(fileStat.st_mtim.tv_sec) * 1000000000 + fileStat.st_mtim.tv_nsec));
+        hash.addData(QByteArray::number(qint64(fileStat.st_size)));
+
+        const QString cachePath = m_cache->directory
+                + QLatin1Char('/')
+                + QString::fromLatin1(hash.result().toHex())
+                + QLatin1Char('-')
+                + QString::number(bucket)
+                + QLatin1String(".jpg");
+
+        QImage image(cachePath);
+        if (!image.isNull()) {
+            const QByteArray encodedCachePath = QFile::encodeName(cachePath);
+            struct stat cacheStat;
+            if (stat(encodedCachePath.constData(), &cacheStat) == 0
+                    && time(nullptr) - cacheStat.st_mtime > touchInterval) {
+                utimensat(AT_FDCWD, encodedCachePath.constData(), nullptr, 0);
+            }
+            return image;
+        }
+
+        int orientation = 1;
+        QByteArray embedded;
+        QFile file(m_filePath);
+        CaptureMetadata metadata;
+        if (file.open(QIODevice::ReadOnly)) {
+            CaptureMetadata::readJpeg(&file, &metadata, &orientation, &embedded);
+            file.close();
+        }
+
+        if (!embedded.isEmpty()) {
+            image = QImage::fromData(embedded, "JPEG");
+            if (!image.isNull() && qMax(image.width(), image.height()) >= bucket) {
+                return applyOrientation(image, orientation);
+            }
+        }
+
+        if (m_cancelled->load()) {
+            return QImage();
+        }
+
+        // Let the decoder scale the image down, which for a JPEG skips most of the work of
+        // decoding at full resolution.
+        QImageReader reader(m_filePath);
+        reader.setAutoTransform(true);
+
+        const QSize size = reader.size();
+        if (size.isValid() && qMax(size.width(), size.height()) > bucket) {
+            reader.setScaledSize(size.scaled(bucket, bucket, Qt::KeepAspectRatio));
+        }
+
+        image = reader.read();
+        if (image.isNull()) {
+            *errorString = reader.errorString();
+            return QImage();
+        }
+
+        QDir().mkpath(m_cache->directory);
+
+        QSaveFile cacheFile(cachePath);
+        if (cacheFile.open(QIODevice::WriteOnly) && image.save(&cacheFile, "JPEG", 85)) {
+            const qint64 cacheSize = cacheFile.size();
+            if (cacheFile.commit() && m_cache->written(cacheSize)) {
+                m_cache->prune();
+            }
+        }
+
+        return image;
+    }
+
+    const QSharedPointer<QAtomicInt> m_cancelled;
+    const QString m_filePath;
+    const QSharedPointer<CaptureThumbnailCache> m_cache;
+    const QSize m_requestedSize;
+};
+
+}
+
+CaptureThumbnailProvider::CaptureThumbnailProvider()
+    : m_cache(new CaptureThumbnailCache(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                + QLatin1String("/thumbnails")))
+{
+    // Decoding is memory intensive, limit the number of photos decoded at once.
+    m_pool.setMaxThreadCount(2);
+}
+
+CaptureThumbnailProvider::~CaptureThumbnailProvider()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+QQuickImageResponse *CaptureThumbnailProvider::requestImageResponse(
+        const QString &id, const QSize &requestedSize)
+{
+    ThumbnailResponse * const response = new ThumbnailResponse;
+
+    const QString filePath = QLatin1Char('/') + QUrl::fromPercentEncoding(id.toUtf8());
+
+    ThumbnailJob * const job = new ThumbnailJob(
+                response->m_cancelled, filePath, requestedSize, m_cache);
+
+    // The job signals the response with a queued connection, which is dropped if the engine
+    // deletes the response first.
+    QObject::connect(job, &ThumbnailJob::done, response, &ThumbnailResponse::complete);
+
+    m_pool.start(job);
+
+    return response;
+}
+
+QString CaptureThumbnailProvider::providerId()
+{
+    return QStringLiteral("capturethumbnail");
+}
+
+#include "capturethumbnailprovider.moc"
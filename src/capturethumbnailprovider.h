@@ -0,0 +1,36 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef CAPTURETHUMBNAILPROVIDER_H
+#define CAPTURETHUMBNAILPROVIDER_H
+
+#include <QQuickAsyncImageProvider>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+// Provides reduced size images of captured photos under image://capturethumbnail/<file path>.
+// The thumbnail embedded in the EXIF data of a photo is used when it is large enough for the
+// requested size, otherwise the photo is decoded at a reduced scale.  Results are kept in a cache
+// directory keyed by the path, modification time and size of the photo so they survive restarts.
+// The least recently used thumbnails are removed when the directory grows past a size limit.
+struct CaptureThumbnailCache;
+
+class CaptureThumbnailProvider : public QQuickAsyncImageProvider
+{
+public:
+    CaptureThumbnailProvider();
+    ~CaptureThumbnailProvider() override;
+
+    QQuickImageResponse *requestImageResponse(const QString &id, const QSize &requestedSize) override;
+
+    static QString providerId();
+
+private:
+    QThreadPool m_pool;
+    const QSharedPointer<CaptureThumbnailCache> m_cache;
+};
+
+#endif
@@ -0,0 +1,105 @@
+// SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "capturetrace.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+Q_LOGGING_CATEGORY(lcCaptureModel, "jolla.camera.capturemodel", QtWarningMsg)
+
+namespace {
+
+class TraceFile
+{
+public:
+    TraceFile()
+        : m_file(QFile::decodeName(qgetenv("JOLLA_CAMERA_TRACE")))
+    {
+        // The array is left open so the trace remains valid if the process is killed, the
+        // trace viewers accept that.
+        if (m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            m_file.write("[\n");
+            m_file.flush();
+        }
+    }
+
+    void write(QJsonObject event)
+    {
+        event.insert(QStringLiteral("pid"), qint64(getpid()));
+        event.insert(QStringLiteral("tid"), qint64(syscall(SYS_gettid)));
+
+        const QByteArray data = QJsonDocument(event).toJson(QJsonDocument::Compact) + ",\n";
+
+        QMutexLocker locker(&m_mutex);
+        m_file.write(data);
+        m_file.flush();
+    }
+
+    QMutex m_mutex;
+    QFile m_file;
+};
+
+Q_GLOBAL_STATIC(TraceFile, traceFile)
+
+}
+
+bool CaptureTrace::isEnabled()
+{
+    static const bool enabled = !qgetenv("JOLLA_CAMERA_TRACE").isEmpty();
+
+    return enabled;
+}
+
+qint64 CaptureTrace::timestamp()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return qint64(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+void CaptureTrace::complete(const char *name, qint64 start, const QVariantMap &arguments)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    const qint64 end = timestamp();
+
+    QJsonObject event;
+    event.insert(QStringLiteral("name"), QLatin1String(name));
+    event.insert(QStringLiteral("cat"), QStringLiteral("capturemodel"));
+    event.insert(QStringLiteral("ph"), QStringLiteral("X"));
+    event.insert(QStringLiteral("ts"), start);
+    event.insert(QStringLiteral("dur"), end - start);
+    if (!arguments.isEmpty()) {
+        event.insert(QStringLiteral("args"), QJsonObject::fromVariantMap(arguments));
+    }
+
+    traceFile()->write(event);
+}
+
+void CaptureTrace::counter(const char *name, const QVariantMap &values)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    QJsonObject event;
+    event.insert(QStringLiteral("name"), QLatin1String(name));
+    event.insert(QStringLiteral("cat"), QStringLiteral("capturemodel"));
+    event.insert(QStringLiteral("ph"), QStringLiteral("C"));
+    event.insert(QStringLiteral("ts"), timestamp());
+    event.insert(QStringLiteral("args"), QJsonObject::fromVariantMap(values));
+
+    traceFile()->write(event);
+}
@@ -0,0 +1,32 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef CAPTURETRACE_H
+#define CAPTURETRACE_H
+
+#include <QLoggingCategory>
+#include <QVariantMap>
+
+Q_DECLARE_LOGGING_CATEGORY(lcCaptureModel)
+
+// Writes Chrome trace event JSON, which can be loaded into chrome://tracing or Perfetto, to the
+// file named by the JOLLA_CAMERA_TRACE environment variable.  Events may be written from any
+// thread and are ignored if the variable isn't set.
+class CaptureTrace
+{
+public:
+    static bool isEnabled();
+
+    // A monotonic time stamp in microseconds.
+    static qint64 timestamp();
+
+    // Records an event which started at start and has just finished.  The arguments are built
+    // by the caller even if tracing is disabled, so calls with arguments check isEnabled() first.
+    static void complete(const char *name, qint64 start, const QVariantMap &arguments = QVariantMap());
+    static void counter(const char *name, const QVariantMap &values);
+};
+
+#endif
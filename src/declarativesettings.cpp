@@ -4,43 +4,653 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
 #include "declarativesettings.h"
+#include "capturecopy.h"
+#include "capturefilename.h"
 
 #include <QDebug>
 #include <QDir>
 #include <QDirIterator>
+#include <QElapsedTimer>
 #include <QEvent>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QMimeDatabase>
+#include <QMutex>
 #include <QQmlComponent>
 #include <QQmlEngine>
+#include <QQuickWindow>
+#include <QSet>
 #include <QSettings>
 #include <QStandardPaths>
 #include <QLocale>
 #include <QTemporaryFile>
+#include <QThread>
+#include <QThreadPool>
 #include <partitionmanager.h>
 
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <sys/statvfs.h>
 #include <sys/types.h>
 #include <limits.h>
 
+static bool cameraStartupLoggingEnabled()
+{
+    static const bool enabled = !qgetenv("CAMERA_STARTUP_LOG").isEmpty();
+    return enabled;
+}
+
+#define CAMERA_STARTUP_MARK(scope, timer, format, ...) \
+    do { \
+        if (cameraStartupLoggingEnabled()) \
+            qInfo("CAMERA_STARTUP " scope " %lld ms " format, \
+                  static_cast<long long>((timer).elapsed()), ##__VA_ARGS__); \
+    } while (false)
+
+struct CaptureCompletionQueue
+{
+    struct Job
+    {
+        QString path;
+        QString targetPath;     // where a video is moved to from the hidden directory
+        QUrl url;
+        bool video = false;
+        bool sync = false;
+    };
+
+    QMutex mutex;
+    QVector<Job> jobs;
+    bool scheduled = false;
+};
+
+struct CaptureMigrationQueue
+{
+    struct Job
+    {
+        QString path;
+        QString directory;
+    };
+
+    QMutex mutex;
+    QVector<Job> jobs;
+    qint64 writeRate = -1;      // the measured write rate of the memory card
+    QAtomicInt recording;
+    bool scheduled = false;
+};
+
+namespace {
+
+// Warn when less than this long can be recorded at the current bit rate.
+const int lowSpaceWarningSeconds = 60;
+const int minSpaceCheckInterval = 2000;
+const int maxSpaceCheckInterval = 60000;
+
+// The amount written to qualify a memory card, in chunks synced at the interval a recording
+// flushes at.  Enough to get past the write cache of a card, without taking long on a good one.
+const int qualificationChunkSize = 1 << 20;
+const int qualificationChunks = 32;
+const int qualificationSyncInterval = 4;
+
+// The time since main() was entered, as recorded by the application, so marks logged from the
+// plugin line up with those of the application.
+struct StartupTimer
+{
+    qint64 elapsed() const
+    {
+        const QVariant start = qApp ? qApp->property("cameraStartupTime") : QVariant();
+        if (!start.isValid()) {
+            return -1;
+        }
+
+        // The reference of a timer started now is the current time on the same clock.
+        QElapsedTimer now;
+        now.start();
+        return now.msecsSinceReference() - start.toLongLong();
+    }
+};
+
+void fixupPermissions(const QString &targetPath)
+{
+    const QByteArray path = targetPath.toUtf8();
+    if (chown(path.constData(), getuid(), getgid()) != 0)
+         qWarning() << "Could not change owner/group of resulting photo capture file:" << targetPath << strerror(errno);
+}
+
+// Renames, fixes up the permissions of and optionally syncs the captures in a completion
+// queue until it is empty.  The free space of the directories completed videos were moved to is
+// reported once at the end of each batch.
+class CompletionBatch : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    explicit CompletionBatch(const QSharedPointer<CaptureCompletionQueue> &queue)
+        : m_queue(queue)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        for (;;) {
+            QVector<CaptureCompletionQueue::Job> jobs;
+            {
+                QMutexLocker locker(&m_queue->mutex);
+                if (m_queue->jobs.isEmpty()) {
+                    m_queue->scheduled = false;
+                    return;
+                }
+                qSwap(jobs, m_queue->jobs);
+            }
+
+            QStringList directories;
+            for (const CaptureCompletionQueue::Job &job : jobs) {
+                if (!job.video) {
+                    fixupPermissions(job.path);
+                    if (job.sync) {
+                        sync(job.path);
+                    }
+                } else if (job.targetPath.isEmpty()) {
+                    emit completed(job.url, job.url);
+                } else if (QFile::rename(job.path, job.targetPath)) {
+                    fixupPermissions(job.targetPath);
+                    if (job.sync) {
+                        sync(job.targetPath);
+                    }
+
+                    const QString directory = QFileInfo(job.targetPath).path();
+                    if (!directories.contains(directory)) {
+                        directories.append(directory);
+                    }
+
+                    emit completed(job.url, QUrl::fromLocalFile(job.targetPath));
+                } else {
+                    QFile::remove(job.path);
+                    emit completed(job.url, QUrl());
+                }
+            }
+
+            for (const QString &directory : directories) {
+                struct statvfs stat;
+                if (statvfs(QFile::encodeName(directory).constData(), &stat) == 0) {
+                    emit spaceAvailable(directory, qint64(stat.f_bavail) * stat.f_frsize);
+                }
+            }
+        }
+    }
+
+signals:
+    void completed(const QUrl &url, const QUrl &completedUrl);
+    void spaceAvailable(const QString &directory, qint64 bytesAvailable);
+
+private:
+    // Flushes a file and the rename of it into its directory to storage.
+    static void sync(const QString &path)
+    {
+        for (const QString &syncPath : { path, QFileInfo(path).path() }) {
+            const int fd = ::open(QFile::encodeName(syncPath).constData(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                fsync(fd);
+                ::close(fd);
+            }
+        }
+    }
+
+    const QSharedPointer<CaptureCompletionQueue> m_queue;
+};
+
+class SpaceCheck : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    explicit SpaceCheck(const QString &directory)
+        : m_directory(directory)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        struct statvfs stat;
+        emit finished(m_directory, statvfs(QFile::encodeName(m_directory).constData(), &stat) == 0
+                ? qint64(stat.f_bavail) * stat.f_frsize
+                : -1);
+    }
+
+signals:
+    void finished(const QString &directory, qint64 bytesAvailable);
+
+private:
+    const QString m_directory;
+};
+
+// Measures the sustained sequential write rate and the worst fsync latency of a memory card by
+// writing a temporary file to it.  Results are cached by the UUID of the filesystem so a card
+// is only measured the first time it's used.
+class StorageQualification : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    StorageQualification(const QString &storagePath, const QString &devicePath)
+        : m_storagePath(storagePath)
+        , m_devicePath(devicePath)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        const QString uuid = filesystemUuid(m_devicePath);
+        QSettings cache(
+                    QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QLatin1String("/storage.ini"),
+                    QSettings::IniFormat);
+
+        if (!uuid.isEmpty()) {
+            cache.beginGroup(uuid);
+            if (cache.contains(QStringLiteral("writeRate"))) {
+                emit finished(
+                            m_storagePath,
+                            cache.value(QStringLiteral("writeRate")).toLongLong(),
+                            cache.value(QStringLiteral("syncLatency")).toInt());
+                return;
+            }
+        }
+
+        qint64 writeRate = -1;
+        int syncLatency = -1;
+        if (!measure(&writeRate, &syncLatency)) {
+            emit finished(m_storagePath, -1, -1);
+            return;
+        }
+
+        if (!uuid.isEmpty()) {
+            cache.setValue(QStringLiteral("writeRate"), writeRate);
+            cache.setValue(QStringLiteral("syncLatency"), syncLatency);
+        }
+
+        emit finished(m_storagePath, writeRate, syncLatency);
+    }
+
+signals:
+    void finished(const QString &storagePath, qint64 writeRate, int syncLatency);
+
+private:
+    static QString filesystemUuid(const QString &devicePath)
+    {
+        const QString device = QFileInfo(devicePath).canonicalFilePath();
+
+        QDirIterator links(QStringLiteral("/dev/disk/by-uuid"), QDir::System);
+        while (!device.isEmpty() && links.hasNext()) {
+            links.next();
+            if (links.fileInfo().canonicalFilePath() == device) {
+                return links.fileName();
+            }
+        }
+        return QString();
+    }
+
+    bool measure(qint64 *writeRate, int *syncLatency)
+    {
+        // Random data so a filesystem which compresses doesn't flatter the card.  It comes from
+        // the kernel so every measurement writes a different pattern, qrand() would repeat the
+        // same one as it is seeded the same on each pool thread, and QRandomGenerator isn't
+        // available in all of the Qt versions the camera is built with.
+        QFile random(QStringLiteral("/dev/urandom"));
+        const QByteArray chunk = random.open(QIODevice::ReadOnly | QIODevice::Unbuffered)
+                ? random.read(qualificationChunkSize)
+                : QByteArray();
+        if (chunk.size() != qualificationChunkSize) {
+            return false;
+        }
+
+        QByteArray path = QFile::encodeName(m_storagePath) + "/.jolla-camera-qualification-XXXXXX";
+        const int fd = mkstemp(path.data());
+        if (fd < 0) {
+            return false;
+        }
+
+        bool ok = true;
+        qint64 maxSync = 0;
+        QElapsedTimer timer;
+        timer.start();
+
+        for (int i = 0; ok && i < qualificationChunks; ++i) {
+            ok = ::write(fd, chunk.constData(), chunk.size()) == chunk.size();
+
+            if (ok && (i + 1) % qualificationSyncInterval == 0) {
+                const qint64 syncStart = timer.nsecsElapsed();
+                ok = fdatasync(fd) == 0;
+                maxSync = qMax(maxSync, timer.nsecsElapsed() - syncStart);
+            }
+        }
+
+        const qint64 elapsed = timer.nsecsElapsed();
+
+        ::close(fd);
+        ::unlink(path.constData());
+
+        if (!ok || elapsed <= 0) {
+            return false;
+        }
+
+        *writeRate = qint64(qualificationChunkSize) * qualificationChunks * 1000000000 / elapsed;
+        *syncLatency = int(maxSync / 1000000);
+        return true;
+    }
+
+    const QString m_storagePath;
+    const QString m_devicePath;
+};
+
+// Moves staged captures to the memory card one at a time, in the order they were taken.  A file
+// is copied to a hidden temporary name and renamed to its final name once it has been synced, so
+// a partially copied capture never appears on the card.  While a video is being recorded the
+// copy is limited to half the measured write rate of the card, leaving the rest for the recording.
+class MigrationTask : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    explicit MigrationTask(const QSharedPointer<CaptureMigrationQueue> &queue)
+        : m_queue(queue)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        for (;;) {
+            CaptureMigrationQueue::Job job;
+            {
+                QMutexLocker locker(&m_queue->mutex);
+                if (m_queue->jobs.isEmpty()) {
+                    m_queue->scheduled = false;
+                    return;
+                }
+                job = m_queue->jobs.takeFirst();
+            }
+
+            const QString targetPath = migrate(job);
+            if (!targetPath.isEmpty()) {
+                emit migrated(QUrl::fromLocalFile(job.path), QUrl::fromLocalFile(targetPath));
+            } else {
+                qWarning() << "Failed to move" << job.path << "to" << job.directory << strerror(errno);
+            }
+        }
+    }
+
+signals:
+    void migrated(const QUrl &url, const QUrl &migratedUrl);
+
+private:
+    QString migrate(const CaptureMigrationQueue::Job &job)
+    {
+        const QByteArray fileName = QFile::encodeName(QFileInfo(job.path).fileName());
+        const QByteArray directory = QFile::encodeName(job.directory);
+
+        if (!QDir().mkpath(job.directory)) {
+            return QString();
+        }
+
+        const QByteArray temporaryPath = directory + "/." + fileName + ".migrating";
+
+        const int source = ::open(QFile::encodeName(job.path).constData(), O_RDONLY | O_CLOEXEC);
+        if (source < 0) {
+            return QString();
+        }
+        const int target = ::open(temporaryPath.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (target < 0) {
+            ::close(source);
+            return QString();
+        }
+
+        bool ok = copy(source, target) && fdatasync(target) == 0;
+
+        ::close(source);
+        ok = ::close(target) == 0 && ok;
+
+        // A file left on the card from an earlier run, or saved there since, may have the same
+        // name, in which case the next free sequence number is used.
+        const QByteArray targetPath = ok
+                ? renameCaptureFile(temporaryPath, directory, fileName)
+                : QByteArray();
+
+        if (!targetPath.isEmpty()) {
+            const QString migratedPath = QFile::decodeName(targetPath);
+            fixupPermissions(migratedPath);
+            ::unlink(QFile::encodeName(job.path).constData());
+            return migratedPath;
+        } else {
+            const int error = errno;
+            ::unlink(temporaryPath.constData());
+            errno = error;
+            return QString();
+        }
+    }
+
+    bool copy(int source, int target)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        qint64 throttled = 0;
+
+        return copyCaptureFile(source, target, [&](qint64 count) {
+            throttle(count, &throttled, &timer);
+            return true;
+        });
+    }
+
+    // Sleeps for long enough to keep the average rate of a copy within what the card can spare
+    // since a recording was started.
+    void throttle(qint64 count, qint64 *throttled, QElapsedTimer *timer)
+    {
+        if (m_queue->recording.load() == 0) {
+            *throttled = 0;
+            timer->restart();
+            return;
+        }
+        *throttled += count;
+
+        qint64 writeRate;
+        {
+            QMutexLocker locker(&m_queue->mutex);
+            writeRate = m_queue->writeRate;
+        }
+        const qint64 rate = writeRate > 0 ? writeRate / 2 : 4 << 20;
+
+        const qint64 due = *throttled * 1000 / rate;
+        const qint64 elapsed = timer->elapsed();
+        if (due > elapsed) {
+            QThread::msleep(qMin<qint64>(due - elapsed, 1000));
+        }
+    }
+
+    const QSharedPointer<CaptureMigrationQueue> m_queue;
+};
+
+// Moves recordings left in the hidden directory, or the date subdirectories within it, by a
+// camera crash to where they would have been completed.  A file modified since the camera
+// started may be a recording in progress and is left alone.  For the staging directory the
+// captures which were completed but not migrated before the camera exited are also reported.
+class RecoveryJob : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    RecoveryJob(const QString &videoDirectory, const QDateTime &startTime, bool staging = false)
+        : m_videoDirectory(videoDirectory)
+        , m_startTime(startTime)
+        , m_staging(staging)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        const QString recordingPath = m_videoDirectory + QLatin1String("/.recording");
+        QMimeDatabase mimeDatabase;
+        QSet<QString> recoveredPaths;
+        int count = 0;
+
+        QDirIterator recordings(recordingPath, QDir::Files, QDirIterator::Subdirectories);
+        while (recordings.hasNext()) {
+            const QString filePath = recordings.next();
+            if (recordings.fileInfo().lastModified() >= m_startTime) {
+                continue;
+            }
+
+            const QString targetPath = m_videoDirectory + filePath.mid(recordingPath.length());
+            QDir().mkpath(QFileInfo(targetPath).absolutePath());
+            if (QFile(filePath).rename(targetPath)) {
+                fixupPermissions(targetPath);
+                recoveredPaths.insert(targetPath);
+
+                emit recovered(
+                            QUrl::fromLocalFile(targetPath),
+                            mimeDatabase.mimeTypeForFile(targetPath, QMimeDatabase::MatchExtension).name());
+                ++count;
+            }
+        }
+
+        if (m_staging) {
+            // The recordings just moved out of the hidden directory have already been reported.
+            QDirIterator staged(m_videoDirectory, QDir::Files);
+            while (staged.hasNext()) {
+                const QString filePath = staged.next();
+                quint64 key;
+                if (!recoveredPaths.contains(filePath)
+                        && staged.fileInfo().lastModified() < m_startTime
+                        && parseCaptureFileName(QFile::encodeName(staged.fileName()).constData(), &key)) {
+                    emit recovered(
+                                QUrl::fromLocalFile(filePath),
+                                mimeDatabase.mimeTypeForFile(filePath, QMimeDatabase::MatchExtension).name());
+                    ++count;
+                }
+            }
+        }
+
+        emit finished(count);
+    }
+
+signals:
+    void recovered(const QUrl &url, const QString &mimeType);
+    void finished(int count);
+
+private:
+    const QString m_videoDirectory;
+    const QDateTime m_startTime;
+    const bool m_staging;
+};
+
+class StorageCheck : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    StorageCheck(
+            int check,
+            const QString &storagePath,
+            const QString &photoDirectory,
+            const QString &videoDirectory)
+        : m_storagePath(storagePath)
+        , m_photoDirectory(photoDirectory)
+        , m_videoDirectory(videoDirectory)
+        , m_check(check)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        bool writable = true;
+        if (!m_storagePath.isEmpty()) {
+            QTemporaryFile file(m_storagePath + QStringLiteral("/XXXXXX.tmp"));
+            file.setAutoRemove(true);
+            writable = file.open();
+        }
+
+        bool created = false;
+        if (writable) {
+            created = !QFileInfo::exists(m_photoDirectory) || !QFileInfo::exists(m_videoDirectory);
+
+            QDir(m_photoDirectory).mkpath(QLatin1String("."));
+            QDir(m_videoDirectory).mkpath(QLatin1String(".recording"));
+        }
+
+        emit finished(m_check, m_storagePath, writable, created);
+    }
+
+signals:
+    void finished(int check, const QString &storagePath, bool writable, bool created);
+
+private:
+    const QString m_storagePath;
+    const QString m_photoDirectory;
+    const QString m_videoDirectory;
+    const int m_check;
+};
+
+}
+
 DeclarativeSettings::DeclarativeSettings(QObject *parent)
     : QObject(parent)
     , m_partitionManager(new PartitionManager(this))
     , m_storagePath(QStringLiteral("/apps/jolla-camera/storagePath"))
     , m_minSpaceForRecording(QStringLiteral("/apps/jolla-camera/minSpaceForRecording"))
+    , m_dateSubdirectories(QStringLiteral("/apps/jolla-camera/dateSubdirectories"))
+    , m_syncCaptures(QStringLiteral("/apps/jolla-camera/syncCaptures"))
+    , m_qualifyStorage(QStringLiteral("/apps/jolla-camera/qualifyStorage"))
+    , m_stageCaptures(QStringLiteral("/apps/jolla-camera/stageCaptures"))
+    , m_migrationThreads(QStringLiteral("/apps/jolla-camera/migrationThreads"))
+    , m_completions(new CaptureCompletionQueue)
+    , m_migrations(new CaptureMigrationQueue)
+    , m_migration(new CaptureMigration(this))
+    , m_startTime(QDateTime::currentDateTime())
     , m_storagePathStatus(NotSet)
     , m_storageMaxFileSize(0)
 {
     connect(&m_storagePath, SIGNAL(valueChanged()), this, SLOT(verifyStoragePath()));
+    connect(&m_stageCaptures, SIGNAL(valueChanged()), this, SLOT(verifyStoragePath()));
     connect(m_partitionManager, SIGNAL(partitionRemoved(const Partition&)), this, SLOT(verifyStoragePath()));
     connect(m_partitionManager, SIGNAL(partitionAdded(const Partition&)), this, SLOT(verifyStoragePath()));
     connect(m_partitionManager, SIGNAL(partitionChanged(const Partition&)), this, SLOT(verifyStoragePath()));
 
-    verifyStoragePath();
+    connect(m_migration, &CaptureMigration::captureMoved, this, &DeclarativeSettings::captureMoved);
+    connect(&m_migrationThreads, &MDConfItem::valueChanged, this, [this]() {
+        m_migration->setThreadCount(m_migrationThreads.value(2).toInt());
+    });
+    m_migration->setThreadCount(m_migrationThreads.value(2).toInt());
+
+    m_verifyTimer.setSingleShot(true);
+    m_verifyTimer.setInterval(0);
+    connect(&m_verifyTimer, &QTimer::timeout, this, &DeclarativeSettings::updateStoragePath);
 
-    // protect against camera crashes leaving files in the hidden directory
-    for (const QFileInfo &info : QDir(videoDirectory() + QLatin1String("/.recording")).entryInfoList(QDir::Files)) {
-        QString targetPath = videoDirectory() + "/" + info.fileName();
-        QFile(info.absoluteFilePath()).rename(targetPath);
-        fixupPermissions(targetPath);
+    m_spaceTimer.setSingleShot(true);
+    connect(&m_spaceTimer, &QTimer::timeout, this, &DeclarativeSettings::checkSpaceAvailable);
+
+    if (QGuiApplication *application = qobject_cast<QGuiApplication *>(QCoreApplication::instance())) {
+        connect(application, &QGuiApplication::applicationStateChanged, this, [this](Qt::ApplicationState state) {
+            if (state == Qt::ApplicationActive) {
+                checkSpaceAvailable();
+            } else {
+                m_spaceTimer.stop();
+            }
+        });
+    }
+
+    updateStoragePath();
+
+    // Recovering recordings left by a crash touches every file in the hidden directory, so
+    // wait until the viewfinder has been drawn.  The settings are created while the QML is
+    // loaded, after the window.
+    bool hasWindow = false;
+    for (QWindow *window : QGuiApplication::topLevelWindows()) {
+        if (QQuickWindow *quickWindow = qobject_cast<QQuickWindow *>(window)) {
+            connect(quickWindow, &QQuickWindow::frameSwapped,
+                    this, &DeclarativeSettings::recoverCaptures, Qt::QueuedConnection);
+            hasWindow = true;
+        }
+    }
+    if (!hasWindow) {
+        QTimer::singleShot(0, this, &DeclarativeSettings::recoverCaptures);
     }
 }
 
@@ -102,31 +712,68 @@ qint64 DeclarativeSettings::storageMaxFileSize() const
     return m_storageMaxFileSize;
 }
 
-void DeclarativeSettings::fixupPermissions(const QString &targetPath)
+void DeclarativeSettings::recoverCaptures()
 {
-    const QByteArray path = targetPath.toUtf8();
-    if (chown(path.constData(), getuid(), getgid()) != 0)
-         qWarning() << "Could not change owner/group of resulting photo capture file:" << targetPath << strerror(errno);
-}
+    if (m_recoveryStarted) {
+        return;
+    }
+    m_recoveryStarted = true;
 
-bool DeclarativeSettings::verifyWritable(const QString &path)
-{
-    QTemporaryFile file(path + QStringLiteral("/XXXXXX.tmp"));
-    file.setAutoRemove(true);
-    return file.open();
+    for (QWindow *window : QGuiApplication::topLevelWindows()) {
+        disconnect(window, nullptr, this, nullptr);
+    }
+
+    CAMERA_STARTUP_MARK("settings", StartupTimer(), "capture recovery started");
+
+    RecoveryJob * const job = new RecoveryJob(videoDirectory(), m_startTime);
+    connect(job, &RecoveryJob::recovered, this, &DeclarativeSettings::captureRecovered);
+    connect(job, &RecoveryJob::finished, this, [](int count) {
+        CAMERA_STARTUP_MARK("settings", StartupTimer(), "capture recovery finished files=%d", count);
+    });
+    QThreadPool::globalInstance()->start(job);
+
+    // Captures staged before the camera exited are migrated now, wherever the storage is.
+    if (QFileInfo::exists(stagingLocation())) {
+        RecoveryJob * const stagingJob = new RecoveryJob(stagingLocation(), m_startTime, true);
+        connect(stagingJob, &RecoveryJob::recovered, this, [this](const QUrl &url, const QString &mimeType) {
+            emit captureRecovered(url, mimeType);
+            enqueueMigration(url.toLocalFile());
+        });
+        QThreadPool::globalInstance()->start(stagingJob);
+    }
+
+    m_migration->resume();
 }
 
-static qint64 getMaxBytes(Partition partition)
+static qint64 getMaxBytes(qint64 bytesAvailable, const QString &filesystemType)
 {
-    qint64 realMaxBytes = partition.bytesAvailable();
-    if (partition.filesystemType() == "vfat" && partition.bytesAvailable() > static_cast<qint64>(ULONG_MAX))
+    qint64 realMaxBytes = bytesAvailable;
+    if (filesystemType == "vfat" && bytesAvailable > static_cast<qint64>(ULONG_MAX))
         realMaxBytes = ULONG_MAX;
 
     return realMaxBytes;
 }
 
+static qint64 getMaxBytes(Partition partition)
+{
+    return getMaxBytes(partition.bytesAvailable(), partition.filesystemType());
+}
+
 void DeclarativeSettings::verifyStoragePath()
 {
+    m_partitionsChanged = true;
+
+    // A card being inserted or mounted emits a series of partition signals, check once they've
+    // all been received.
+    if (!m_verifyTimer.isActive()) {
+        m_verifyTimer.start();
+    }
+}
+
+void DeclarativeSettings::updateStoragePath()
+{
+    m_verifyTimer.stop();
+
     const QString prevPhotoPath = m_photoDirectory;
     const QString prevVideoPath = m_videoDirectory;
 
@@ -134,6 +781,13 @@ void DeclarativeSettings::verifyStoragePath()
     StoragePathStatus oldStatus = m_storagePathStatus;
     qint64 oldMaxBytes = m_storageMaxFileSize;
 
+    const bool partitionsChanged = m_partitionsChanged;
+    m_partitionsChanged = false;
+
+    // A storage which has been remounted may no longer have the directories.
+    m_captureDirectories.clear();
+    bool unwritable = false;
+
     m_storagePathStatus = path.isEmpty() ? NotSet : Unavailable;
 
     if (!path.isEmpty()) {
@@ -142,14 +796,18 @@ void DeclarativeSettings::verifyStoragePath()
                                [path](const Partition &partition) { return partition.mountPath() == path; });
         if (it != partitions.end()) {
             const Partition &partition = *it;
-            if (partition.status() == Partition::Mounted) {
-                if (verifyWritable(storagePath())) {
-                    m_storagePathStatus = Available;
-                    m_storageMaxFileSize = getMaxBytes(partition);
-                } else {
-                    m_storagePathStatus = Unavailable;
-                    m_storageMaxFileSize = 0;
-                }
+            // A mounted card is assumed to be writable until the check on the worker thread
+            // finds otherwise.
+            if (partition.status() == Partition::Mounted && path != m_unwritablePath) {
+                m_storagePathStatus = Available;
+                m_storageMaxFileSize = getMaxBytes(partition);
+                m_storageFilesystem = partition.filesystemType();
+                m_storageDevice = partition.devicePath();
+                m_storageReserve = 0;
+            } else if (partition.status() == Partition::Mounted) {
+                m_storagePathStatus = Unavailable;
+                m_storageMaxFileSize = 0;
+                unwritable = true;
             } else if(partition.status() == Partition::Mounting) {
                 m_storagePathStatus = Mounting;
                 m_storageMaxFileSize = 0;
@@ -157,6 +815,14 @@ void DeclarativeSettings::verifyStoragePath()
         }
     }
 
+    // A card which has been unmounted or removed is assumed to be writable when it's next mounted.
+    // One which is still mounted is tested again whenever the partitions change, and used again
+    // once it passes.
+    if (!unwritable) {
+        m_unwritablePath.clear();
+    }
+    const bool retest = unwritable && partitionsChanged;
+
     if (m_storagePathStatus == Available && !path.isEmpty()) {
         m_photoDirectory = path + QStringLiteral("/Pictures/Camera");
         m_videoDirectory = path + QStringLiteral("/Videos/Camera");
@@ -168,20 +834,47 @@ void DeclarativeSettings::verifyStoragePath()
             return QStandardPaths::writableLocation(QStandardPaths::MoviesLocation).startsWith(partition.mountPath()); });
         if (it != partitions.end()) {
             const Partition &partition = *it;
-            m_storageMaxFileSize = qMax((qint64)0,
-                                        getMaxBytes(partition) - (m_minSpaceForRecording.value(100).toLongLong() << 20));
+            m_storageFilesystem = partition.filesystemType();
+            m_storageReserve = m_minSpaceForRecording.value(100).toLongLong() << 20;
+            m_storageMaxFileSize = qMax((qint64)0, getMaxBytes(partition) - m_storageReserve);
         } else {
             m_storageMaxFileSize = 0;
+            m_storageReserve = -1;
         }
     }
 
-    QDir(m_photoDirectory).mkpath(QLatin1String("."));
-    QDir(m_videoDirectory).mkpath(QLatin1String(".recording"));
+    // Touching the card can stall for as long as it takes to wake up, so the write test and
+    // creating the directories are done by a worker thread.  Only the result of the latest
+    // check is used.
+    StorageCheck * const check = new StorageCheck(
+                ++m_storageChecks,
+                m_storagePathStatus == Available || retest ? path : QString(),
+                m_photoDirectory,
+                m_videoDirectory);
+    connect(check, &StorageCheck::finished, this, &DeclarativeSettings::storageChecked);
+    QThreadPool::globalInstance()->start(check);
+
+    // Captures are staged on internal storage while a memory card is in use, if enabled.
+    const QString previousStagingDirectory = m_stagingDirectory;
+    m_stagingDirectory = m_storagePathStatus == Available && m_stageCaptures.value(false).toBool()
+            ? stagingLocation()
+            : QString();
+    if (m_stagingDirectory != previousStagingDirectory) {
+        emit stagingDirectoryChanged();
+    }
+
+    if (m_storagePathStatus != Available) {
+        // Internal storage isn't qualified.
+        m_qualifiedPath.clear();
+        updateStorageQualification(-1, -1);
+    }
 
     if (prevPhotoPath != m_photoDirectory) {
         emit photoDirectoryChanged();
     }
     if (prevVideoPath != m_videoDirectory) {
+        checkSpaceAvailable();
+
         emit videoDirectoryChanged();
     }
 
@@ -194,11 +887,84 @@ void DeclarativeSettings::verifyStoragePath()
     }
 }
 
+void DeclarativeSettings::storageChecked(int check, const QString &path, bool writable, bool created)
+{
+    if (check != m_storageChecks) {
+        return;
+    }
+
+    if (created) {
+        emit storageDirectoriesCreated();
+    }
+
+    if (!writable && m_unwritablePath != path) {
+        // Fall back to the internal storage.
+        m_unwritablePath = path;
+        updateStoragePath();
+    } else if (writable && !path.isEmpty()) {
+        if (m_unwritablePath == path) {
+            // The card failed an earlier test but has passed this one.
+            m_unwritablePath.clear();
+            updateStoragePath();
+            return;
+        }
+
+        if (m_qualifyStorage.value(false).toBool() && m_qualifiedPath != path) {
+            m_qualifiedPath = path;
+
+            StorageQualification * const qualification = new StorageQualification(path, m_storageDevice);
+            connect(qualification, &StorageQualification::finished,
+                    this, &DeclarativeSettings::storageQualified);
+            QThreadPool::globalInstance()->start(qualification);
+        }
+    }
+
+    // A migration interrupted by a storage being unavailable can continue once one is checked,
+    // but not before the recovery after startup.
+    if (writable && m_recoveryStarted && m_migration->isInterrupted()) {
+        m_migration->resume();
+    }
+}
+
+void DeclarativeSettings::storageQualified(const QString &path, qint64 writeRate, int syncLatency)
+{
+    if (path == m_qualifiedPath) {
+        updateStorageQualification(writeRate, syncLatency);
+    }
+}
+
+void DeclarativeSettings::updateStorageQualification(qint64 writeRate, int syncLatency)
+{
+    if (m_storageWriteRate != writeRate || m_storageSyncLatency != syncLatency) {
+        m_storageWriteRate = writeRate;
+        m_storageSyncLatency = syncLatency;
+
+        QMutexLocker locker(&m_migrations->mutex);
+        m_migrations->writeRate = writeRate;
+        locker.unlock();
+
+        emit storageQualificationChanged();
+    }
+}
+
+qint64 DeclarativeSettings::storageWriteRate() const
+{
+    return m_storageWriteRate;
+}
+
+int DeclarativeSettings::storageSyncLatency() const
+{
+    return m_storageSyncLatency;
+}
+
 QString DeclarativeSettings::photoCapturePath(const QString &extension)
 {
     verifyCapturePrefix();
 
-    QString fileFormat(photoDirectory() + QLatin1Char('/') + m_prefix + QLatin1String("%1.") + extension);
+    // A staged capture is filed in a date subdirectory when it's migrated.
+    QString fileFormat(!m_stagingDirectory.isEmpty()
+            ? m_stagingDirectory + QLatin1Char('/') + m_prefix + QLatin1String("%1.") + extension
+            : photoDirectory() + dateSubdirectory(photoDirectory()) + QLatin1Char('/') + m_prefix + QLatin1String("%1.") + extension);
     return capturePath(fileFormat);
 }
 
@@ -206,13 +972,30 @@ QString DeclarativeSettings::videoCapturePath(const QString &extension)
 {
     verifyCapturePrefix();
 
-    QString fileFormat(videoDirectory() + QLatin1String("/.recording/") + m_prefix + QLatin1String("%1.") + extension);
+    if (!m_stagingDirectory.isEmpty()) {
+        return capturePath(m_stagingDirectory + QLatin1String("/.recording/") + m_prefix + QLatin1String("%1.") + extension);
+    }
+
+    // The recording is moved out of .recording to the same date subdirectory by completeCapture().
+    const QString recordingDirectory = videoDirectory() + QLatin1String("/.recording");
+    const QString subdirectory = dateSubdirectory(recordingDirectory);
+    if (!subdirectory.isEmpty()) {
+        QDir(videoDirectory()).mkpath(subdirectory.mid(1));
+    }
+
+    QString fileFormat(recordingDirectory + subdirectory + QLatin1Char('/') + m_prefix + QLatin1String("%1.") + extension);
     return capturePath(fileFormat);
 }
 
 void DeclarativeSettings::completePhoto(const QUrl &file)
 {
-    fixupPermissions(file.path());
+    const QString path = file.toLocalFile();
+    if (isStaged(path)) {
+        // The permissions are fixed up when it's migrated.
+        enqueueMigration(path);
+    } else {
+        enqueueCompletion(path);
+    }
 }
 
 void DeclarativeSettings::refreshMaxFileSize()
@@ -220,49 +1003,295 @@ void DeclarativeSettings::refreshMaxFileSize()
     m_partitionManager->refresh();
 }
 
-QUrl DeclarativeSettings::completeCapture(const QUrl &file)
+void DeclarativeSettings::completeCapture(const QUrl &file)
 {
     const QString recordingDir = QStringLiteral("/.recording/");
     const QString absolutePath = file.toLocalFile();
-    const int index = absolutePath.lastIndexOf(recordingDir) + 1;
-    if (index == -1) {
-        return file;
+    const int index = absolutePath.lastIndexOf(recordingDir);
+
+    QString targetPath;
+    if (index != -1) {
+        targetPath = absolutePath;
+        targetPath.remove(index + 1, recordingDir.length() - 1);
+    }
+
+    enqueueCompletion(absolutePath, targetPath, file);
+}
+
+// Captures are completed in the order they were taken, by a single task at a time which takes
+// every capture queued while it was busy.
+void DeclarativeSettings::enqueueCompletion(const QString &path, const QString &targetPath, const QUrl &url)
+{
+    CaptureCompletionQueue::Job job;
+    job.path = path;
+    job.targetPath = targetPath;
+    job.url = url;
+    job.video = url.isValid();
+    job.sync = m_syncCaptures.value(false).toBool();
+
+    QMutexLocker locker(&m_completions->mutex);
+
+    m_completions->jobs.append(job);
+
+    if (!m_completions->scheduled) {
+        m_completions->scheduled = true;
+
+        CompletionBatch * const batch = new CompletionBatch(m_completions);
+        connect(batch, &CompletionBatch::completed, this, &DeclarativeSettings::completionFinished);
+        connect(batch, &CompletionBatch::spaceAvailable, this, &DeclarativeSettings::updateMaxFileSize);
+        QThreadPool::globalInstance()->start(batch);
+    }
+}
+
+void DeclarativeSettings::completionFinished(const QUrl &url, const QUrl &completedUrl)
+{
+    emit captureCompleted(url, completedUrl);
+
+    if (isStaged(completedUrl.toLocalFile())) {
+        enqueueMigration(completedUrl.toLocalFile());
+    }
+}
+
+QString DeclarativeSettings::stagingDirectory() const
+{
+    return m_stagingDirectory;
+}
+
+CaptureMigration *DeclarativeSettings::migration() const
+{
+    return m_migration;
+}
+
+bool DeclarativeSettings::migrateCaptures(const QString &storagePath)
+{
+    QStringList sourceDirectories;
+    if (storagePath.isEmpty()) {
+        sourceDirectories
+                << QStandardPaths::writableLocation(QStandardPaths::PicturesLocation) + QLatin1String("/Camera")
+                << QStandardPaths::writableLocation(QStandardPaths::MoviesLocation) + QLatin1String("/Camera");
+    } else {
+        sourceDirectories
+                << storagePath + QLatin1String("/Pictures/Camera")
+                << storagePath + QLatin1String("/Videos/Camera");
+    }
+
+    return m_migration->start(sourceDirectories, QStringList() << m_photoDirectory << m_videoDirectory);
+}
+
+QString DeclarativeSettings::stagingLocation()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/jolla-camera/staging");
+}
+
+bool DeclarativeSettings::isStaged(const QString &path)
+{
+    return path.startsWith(stagingLocation() + QLatin1Char('/'));
+}
+
+// Staged captures are moved to where they would have been saved, on the storage in use when
+// they're migrated.
+void DeclarativeSettings::enqueueMigration(const QString &path)
+{
+    const QString fileName = QFileInfo(path).fileName();
+
+    CaptureMigrationQueue::Job job;
+    job.path = path;
+    job.directory = fileName.endsWith(QLatin1String(".mp4")) ? m_videoDirectory : m_photoDirectory;
+    if (m_dateSubdirectories.value(false).toBool()) {
+        job.directory += QLatin1Char('/') + fileName.mid(0, 4) + QLatin1Char('/') + fileName.mid(4, 2);
+    }
+
+    QMutexLocker locker(&m_migrations->mutex);
+
+    m_migrations->jobs.append(job);
+    m_migrations->writeRate = m_storageWriteRate;
+
+    if (!m_migrations->scheduled) {
+        m_migrations->scheduled = true;
+
+        MigrationTask * const task = new MigrationTask(m_migrations);
+        connect(task, &MigrationTask::migrated, this, &DeclarativeSettings::captureMoved);
+        QThreadPool::globalInstance()->start(task);
+    }
+}
+
+void DeclarativeSettings::updateMaxFileSize(const QString &directory, qint64 bytesAvailable)
+{
+    if (!directory.startsWith(m_videoDirectory)) {
+        return;
+    }
+
+    updateSpaceAvailable(bytesAvailable);
+
+    if (m_storageReserve < 0) {
+        return;
+    }
+
+    const qint64 maxBytes = qMax(
+                qint64(0), getMaxBytes(bytesAvailable, m_storageFilesystem) - m_storageReserve);
+    if (m_storageMaxFileSize != maxBytes) {
+        m_storageMaxFileSize = maxBytes;
+        emit storageMaxFileSizeChanged();
+    }
+}
+
+qint64 DeclarativeSettings::storageBytesAvailable() const
+{
+    return m_storageBytesAvailable;
+}
+
+qint64 DeclarativeSettings::storageSecondsRemaining() const
+{
+    return m_storageSecondsRemaining;
+}
+
+int DeclarativeSettings::recordingBitRate() const
+{
+    return m_recordingBitRate;
+}
+
+void DeclarativeSettings::setRecordingBitRate(int bitRate)
+{
+    if (m_recordingBitRate != bitRate) {
+        m_recordingBitRate = bitRate;
+
+        emit recordingBitRateChanged();
+
+        if (m_storageBytesAvailable >= 0) {
+            updateSpaceAvailable(m_storageBytesAvailable);
+        }
+    }
+}
+
+bool DeclarativeSettings::isRecording() const
+{
+    return m_migrations->recording.load() != 0;
+}
+
+// Bound to the state of the recorder, so staging copies are only throttled while a video is
+// actually being recorded however the recording ends.
+void DeclarativeSettings::setRecording(bool recording)
+{
+    if (isRecording() != recording) {
+        m_migrations->recording.store(recording ? 1 : 0);
+
+        emit recordingChanged();
     }
+}
 
-    QString targetPath = absolutePath;
-    targetPath.remove(index, recordingDir.length() - 1);
+void DeclarativeSettings::checkSpaceAvailable()
+{
+    if (m_spaceCheckPending || m_videoDirectory.isEmpty()) {
+        return;
+    }
+    m_spaceCheckPending = true;
 
-    if (QFile::rename(absolutePath, targetPath)) {
-        fixupPermissions(targetPath);
-        refreshMaxFileSize();
-        return QUrl::fromLocalFile(targetPath);
+    SpaceCheck * const check = new SpaceCheck(m_videoDirectory);
+    connect(check, &SpaceCheck::finished, this, &DeclarativeSettings::spaceChecked);
+    QThreadPool::globalInstance()->start(check);
+}
+
+void DeclarativeSettings::spaceChecked(const QString &directory, qint64 bytesAvailable)
+{
+    m_spaceCheckPending = false;
+
+    if (directory != m_videoDirectory) {
+        // The storage changed while the old directory was being checked.
+        checkSpaceAvailable();
     } else {
-        QFile::remove(absolutePath);
-        return QUrl();
+        updateSpaceAvailable(bytesAvailable);
     }
 }
 
+void DeclarativeSettings::updateSpaceAvailable(qint64 bytesAvailable)
+{
+    // The same space is kept free as limits the size of a recording, which is none on a memory
+    // card.  Nothing is held back if the partition isn't known.
+    const qint64 reserve = qMax(qint64(0), m_storageReserve);
+    const qint64 secondsRemaining = bytesAvailable >= 0 && m_recordingBitRate > 0
+            ? qMax(qint64(0), bytesAvailable - reserve) * 8 / m_recordingBitRate
+            : -1;
+
+    if (m_storageBytesAvailable != bytesAvailable || m_storageSecondsRemaining != secondsRemaining) {
+        m_storageBytesAvailable = bytesAvailable;
+        m_storageSecondsRemaining = secondsRemaining;
+
+        emit storageSpaceChanged();
+    }
+
+    const bool low = secondsRemaining >= 0 && secondsRemaining < lowSpaceWarningSeconds;
+    if (low && !m_storageSpaceLow) {
+        m_storageSpaceLow = true;
+        emit storageSpaceLow();
+    } else if (!low) {
+        m_storageSpaceLow = false;
+    }
+
+    // Check more often as the space runs out, so a recording uses up no more than about a
+    // twentieth of the remaining time between checks.  Nothing is written while the camera is in
+    // the background so the monitor waits until it is activated again.
+    if (QGuiApplication::applicationState() == Qt::ApplicationActive) {
+        m_spaceTimer.start(secondsRemaining >= 0
+                ? int(qBound<qint64>(minSpaceCheckInterval, secondsRemaining * 50, maxSpaceCheckInterval))
+                : maxSpaceCheckInterval);
+    } else {
+        m_spaceTimer.stop();
+    }
+}
+
+QString DeclarativeSettings::dateSubdirectory(const QString &directory)
+{
+    if (!m_dateSubdirectories.value(false).toBool()) {
+        return QString();
+    }
+
+    // Keeps the number of entries in each directory down, which makes listing and looking up
+    // files faster, particularly on vfat.
+    const QString subdirectory = QLocale::c().toString(m_prefixDate, QLatin1String("yyyy/MM"));
+    QDir(directory).mkpath(subdirectory);
+
+    return QLatin1Char('/') + subdirectory;
+}
+
 void DeclarativeSettings::verifyCapturePrefix()
 {
     const QDateTime currentDate = QDateTime::currentDateTime();
-    if (m_prefixDate != currentDate) {
+    const QString prefix = QLocale::c().toString(currentDate, QLatin1String("yyyyMMdd_HHmmss"));
+    if (m_prefix != prefix) {
         m_prefixDate = currentDate;
-        m_prefix = QLocale::c().toString(currentDate, QLatin1String("yyyyMMdd_HHmmss"));
+        m_prefix = prefix;
+        m_sequence = 0;
     }
 }
 
 QString DeclarativeSettings::capturePath(const QString &format)
 {
-    QString path = format.arg(QString(""));
-    if (!QFile::exists(path)) {
-        return path;
+    // Sequence numbers are handed out in memory for the current second, so a burst normally
+    // costs one access() per capture.  A name already taken by a file left from an earlier run
+    // or another application moves on to the next number.  This doesn't make the name safe from
+    // another writer which creates it before the camera opens it.  The name isn't reserved by
+    // creating the file, because an empty file would appear in the gallery as soon as it was
+    // closed and would be left behind by a capture which failed.
+    const QString directory = QFileInfo(format).path();
+    if (!m_captureDirectories.contains(directory)) {
+        // The directory is created by a worker thread when the storage path changes, and a
+        // capture may be taken before it has got to it.
+        QDir().mkpath(directory);
+        m_captureDirectories.insert(directory);
     }
 
-    int counter = 1;
     for (;;) {
-        path = format.arg(QString(QStringLiteral("_%1")).arg(counter, 3, 10, QLatin1Char('0')));
-        if (!QFile::exists(path))
+        const QString path = m_sequence == 0
+                ? format.arg(QString())
+                : format.arg(QStringLiteral("_%1").arg(m_sequence, 3, 10, QLatin1Char('0')));
+        ++m_sequence;
+
+        // Any error other than an existing file is left to the writer to report.
+        if (::access(QFile::encodeName(path).constData(), F_OK) != 0) {
             return path;
-        ++counter;
+        }
     }
 }
+
+#include "declarativesettings.moc"
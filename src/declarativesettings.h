@@ -10,16 +10,23 @@
 
 #include <QObject>
 #include <QDateTime>
+#include <QTimer>
 
+#include <QSet>
+#include <QSharedPointer>
 #include <QUrl>
 #include <MDConfItem>
 
+#include "capturemigration.h"
+
 QT_BEGIN_NAMESPACE
 class QQmlEngine;
 class QJSEngine;
 QT_END_NAMESPACE
 
 class PartitionManager;
+struct CaptureCompletionQueue;
+struct CaptureMigrationQueue;
 
 class DeclarativeSettings : public QObject
 {
@@ -29,6 +36,14 @@ class DeclarativeSettings : public QObject
     Q_PROPERTY(QString storagePath READ storagePath WRITE setStoragePath NOTIFY storagePathChanged)
     Q_PROPERTY(qint64 storageMaxFileSize READ storageMaxFileSize NOTIFY storageMaxFileSizeChanged)
     Q_PROPERTY(StoragePathStatus storagePathStatus READ storagePathStatus NOTIFY storagePathStatusChanged)
+    Q_PROPERTY(qint64 storageBytesAvailable READ storageBytesAvailable NOTIFY storageSpaceChanged)
+    Q_PROPERTY(qint64 storageSecondsRemaining READ storageSecondsRemaining NOTIFY storageSpaceChanged)
+    Q_PROPERTY(int recordingBitRate READ recordingBitRate WRITE setRecordingBitRate NOTIFY recordingBitRateChanged)
+    Q_PROPERTY(bool recording READ isRecording WRITE setRecording NOTIFY recordingChanged)
+    Q_PROPERTY(qint64 storageWriteRate READ storageWriteRate NOTIFY storageQualificationChanged)
+    Q_PROPERTY(int storageSyncLatency READ storageSyncLatency NOTIFY storageQualificationChanged)
+    Q_PROPERTY(QString stagingDirectory READ stagingDirectory NOTIFY stagingDirectoryChanged)
+    Q_PROPERTY(CaptureMigration *migration READ migration CONSTANT)
     Q_ENUMS(StoragePathStatus)
 
 public:
@@ -54,10 +69,37 @@ public:
     qint64 storageMaxFileSize() const;
     Q_INVOKABLE void refreshMaxFileSize();
 
+    // The free space of the video directory, and how long could be recorded in it at the
+    // recording bit rate while leaving the space reserved on internal storage free.  Both are -1
+    // if unknown.
+    qint64 storageBytesAvailable() const;
+    qint64 storageSecondsRemaining() const;
+
+    int recordingBitRate() const;
+    void setRecordingBitRate(int bitRate);
+
+    bool isRecording() const;
+    void setRecording(bool recording);
+
+    // The sustained write rate in bytes per second and the longest fsync in milliseconds measured
+    // on the memory card, or -1 if the card hasn't been measured or internal storage is in use.
+    qint64 storageWriteRate() const;
+    int storageSyncLatency() const;
+
+    // The directory on internal storage captures are saved to before they're migrated to the
+    // memory card, or an empty string if captures are saved directly.
+    QString stagingDirectory() const;
+
+    CaptureMigration *migration() const;
+
+    // Moves the captures saved on another storage, or the internal storage if the path is empty,
+    // to the photo and video directories in use.
+    Q_INVOKABLE bool migrateCaptures(const QString &storagePath);
+
     Q_INVOKABLE QString photoCapturePath(const QString &extension);
     Q_INVOKABLE QString videoCapturePath(const QString &extension);
 
-    Q_INVOKABLE QUrl completeCapture(const QUrl &file);
+    Q_INVOKABLE void completeCapture(const QUrl &file);
     Q_INVOKABLE void completePhoto(const QUrl &file);
 
 signals:
@@ -66,24 +108,92 @@ signals:
     void storagePathChanged();
     void storagePathStatusChanged();
     void storageMaxFileSizeChanged();
+    void storageSpaceChanged();
+    void recordingBitRateChanged();
+    void recordingChanged();
+    void storageQualificationChanged();
+
+    // Less than a minute of recording remains before the free space reaches the reserve.
+    void storageSpaceLow();
+
+    // A recording left in the hidden directory by a crash has been moved to the video directory.
+    void captureRecovered(const QUrl &url, const QString &mimeType);
+
+    // A video passed to completeCapture() has been moved out of the hidden directory.  The
+    // completed url is empty if the video could not be moved, in which case it is removed.
+    void captureCompleted(const QUrl &url, const QUrl &completedUrl);
+
+    // A staged capture has been migrated to the memory card, or a capture has been moved from
+    // another storage by migrateCaptures().
+    void captureMoved(const QUrl &url, const QUrl &movedUrl);
+
+    void stagingDirectoryChanged();
+
+    // The photo or video directory didn't exist and has been created, the paths are unchanged.
+    void storageDirectoriesCreated();
 
 private slots:
     void verifyStoragePath();
+    void recoverCaptures();
 
 private:
-    void fixupPermissions(const QString &targetPath);
-    bool verifyWritable(const QString &path);
+    void updateStoragePath();
+    void enqueueCompletion(const QString &path, const QString &targetPath = QString(), const QUrl &url = QUrl());
+    void completionFinished(const QUrl &url, const QUrl &completedUrl);
+    void enqueueMigration(const QString &path);
+    static QString stagingLocation();
+    static bool isStaged(const QString &path);
+    void updateMaxFileSize(const QString &directory, qint64 bytesAvailable);
+    void checkSpaceAvailable();
+    void spaceChecked(const QString &directory, qint64 bytesAvailable);
+    void updateSpaceAvailable(qint64 bytesAvailable);
+    void storageChecked(int check, const QString &path, bool writable, bool created);
+    void storageQualified(const QString &path, qint64 writeRate, int syncLatency);
+    void updateStorageQualification(qint64 writeRate, int syncLatency);
     void verifyCapturePrefix();
+    QString dateSubdirectory(const QString &directory);
     QString capturePath(const QString &format);
 
     PartitionManager *m_partitionManager;
     MDConfItem m_storagePath;
     MDConfItem m_minSpaceForRecording;
+    MDConfItem m_dateSubdirectories;
+    MDConfItem m_syncCaptures;
+    MDConfItem m_qualifyStorage;
+    MDConfItem m_stageCaptures;
+    MDConfItem m_migrationThreads;
+    QSharedPointer<CaptureCompletionQueue> m_completions;
+    QSharedPointer<CaptureMigrationQueue> m_migrations;
+    CaptureMigration *m_migration;
+    const QDateTime m_startTime;
 
     QString m_prefix;
     QString m_photoDirectory;
     QString m_videoDirectory;
+    QString m_stagingDirectory;
     QDateTime m_prefixDate;
+    int m_sequence = 0;     // the next sequence number for the current prefix
+    QSet<QString> m_captureDirectories;    // the directories capturePath() has created
+
+    QTimer m_verifyTimer;
+    QString m_unwritablePath;   // a mounted storage path which failed the write test
+    bool m_partitionsChanged = false;   // the partitions or storage path changed since the last update
+    int m_storageChecks = 0;
+    bool m_recoveryStarted = false;
+
+    QString m_storageFilesystem;
+    QString m_storageDevice;
+    QString m_qualifiedPath;    // the memory card measured, or being measured
+    qint64 m_storageWriteRate = -1;
+    int m_storageSyncLatency = -1;
+    qint64 m_storageReserve = -1;   // space kept free of recordings, -1 if the partition is unknown
+
+    QTimer m_spaceTimer;
+    qint64 m_storageBytesAvailable = -1;
+    qint64 m_storageSecondsRemaining = -1;
+    int m_recordingBitRate = 0;
+    bool m_spaceCheckPending = false;
+    bool m_storageSpaceLow = false;
 
     StoragePathStatus m_storagePathStatus;
     qint64 m_storageMaxFileSize;
@@ -17,13 +17,30 @@ PKGCONFIG += mlite5 systemsettings
 
 SOURCES += \
         cameraplugin.cpp \
+        captureindex.cpp \
+        capturemetadata.cpp \
+        capturemigration.cpp \
         capturemodel.cpp \
+        capturemodelstatistics.cpp \
+        capturesectionmodel.cpp \
+        capturethumbnailprovider.cpp \
+        capturetrace.cpp \
         declarativecameraextensions.cpp \
         declarativesettings.cpp \
         cameraconfigs.cpp
 
 HEADERS += \
+        capturecopy.h \
+        capturefilename.h \
+        captureindex.h \
+        capturelist.h \
+        capturemetadata.h \
+        capturemigration.h \
         capturemodel.h \
+        capturemodelstatistics.h \
+        capturesectionmodel.h \
+        capturethumbnailprovider.h \
+        capturetrace.h \
         declarativecameraextensions.h \
         declarativesettings.h \
         cameraconfigs.h
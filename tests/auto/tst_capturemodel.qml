@@ -36,6 +36,15 @@ Item {
         "captures3/20210504_165138.jpg"
     ]
 
+    // Captures filed in YYYY/MM subdirectories, captures4/other isn't a date subdirectory and is
+    // ignored.
+    readonly property var fileNames4: [
+        "captures4/2021/05/20210514_153000.jpg",
+        "captures4/2021/05/20210503_084511.jpg",
+        "captures4/2021/04/20210424_101500.jpg",
+        "captures4/2021/04/20210411_181203.jpg",
+        "captures4/20210402_093012.jpg"
+    ]
 
     width: 540
     height: 960
@@ -44,6 +53,12 @@ Item {
         id: captureModel
     }
 
+    CaptureSectionModel {
+        id: sectionModel
+
+        captureModel: captureModel
+    }
+
     Item {
         Repeater {
             id: repeater
@@ -52,6 +67,7 @@ Item {
             delegate: Item {
                 property string url: model.url
                 property string mimeType: model.mimeType
+                property var captureTime: model.captureTime
             }
         }
     }
@@ -60,6 +76,8 @@ Item {
 
         function init() {
             captureModel.directories = []
+            captureModel.pageSize = 0
+            sectionModel.granularity = CaptureSectionModel.Day
             tryCompare(captureModel, "count", 0)
             tryCompare(repeater, "count", 0)
         }
@@ -80,8 +98,12 @@ Item {
                 verify(item)
 
                 compare(item.url, "file:///opt/tests/jolla-camera/auto/" + fileNames1[i])
+                compare(Qt.formatDateTime(item.captureTime, "yyyyMMdd_hhmmss"), fileNames1[i].slice(10, 25))
             }
 
+            verify(captureModel.stats.scans > 0)
+            verify(captureModel.stats.rowsInserted >= fileNames1.length)
+
             captureModel.directories = [
                 "/opt/tests/jolla-camera/auto/captures2"
             ]
@@ -160,6 +182,83 @@ Item {
             }
         }
 
+        function test_dateSubdirectories() {
+            var i
+            var item
+
+            captureModel.directories = [
+                "/opt/tests/jolla-camera/auto/captures4"
+            ]
+
+            tryCompare(captureModel, "count", fileNames4.length)
+            tryCompare(repeater, "count", fileNames4.length)
+
+            for (i = 0; i < fileNames4.length; ++i) {
+                item = repeater.itemAt(i)
+                verify(item)
+
+                compare(item.url, "file:///opt/tests/jolla-camera/auto/" + fileNames4[i])
+            }
+
+            captureModel.directories = [
+                "/opt/tests/jolla-camera/auto/captures1",
+                "/opt/tests/jolla-camera/auto/captures4"
+            ]
+
+            var fileNames = fileNames1.concat(fileNames4).sort(function (left, right) {
+                return -left.slice(left.lastIndexOf("/")).localeCompare(right.slice(right.lastIndexOf("/")))
+            })
+
+            tryCompare(captureModel, "count", fileNames.length)
+            tryCompare(repeater, "count", fileNames.length)
+
+            for (i = 0; i < fileNames.length; ++i) {
+                item = repeater.itemAt(i)
+                verify(item)
+
+                compare(item.url, "file:///opt/tests/jolla-camera/auto/" + fileNames[i])
+            }
+        }
+
+        function test_sections() {
+            captureModel.directories = [
+                "/opt/tests/jolla-camera/auto/captures1"
+            ]
+
+            tryCompare(captureModel, "count", fileNames1.length)
+
+            // 4 captures on the 14th of May, 1 on the 4th and 2 on the 24th of April.
+            compare(sectionModel.count, 3)
+            compare(sectionModel.rowForDate(new Date(2021, 4, 14)), 0)
+            compare(sectionModel.rowForDate(new Date(2021, 4, 10)), 4)
+            compare(sectionModel.rowForDate(new Date(2021, 4, 4)), 4)
+            compare(sectionModel.rowForDate(new Date(2021, 3, 30)), 5)
+            compare(sectionModel.rowForDate(new Date(2021, 3, 1)), -1)
+
+            compare(Qt.formatDate(sectionModel.dateForRow(3), "yyyyMMdd"), "20210514")
+            compare(Qt.formatDate(sectionModel.dateForRow(4), "yyyyMMdd"), "20210504")
+            compare(Qt.formatDate(sectionModel.dateForRow(6), "yyyyMMdd"), "20210424")
+            compare(sectionModel.sectionForRow(5), 2)
+            compare(sectionModel.sectionForRow(7), -1)
+
+            captureModel.appendCapture("file:///opt/tests/jolla-camera/auto/captures1/20210504_170000.jpg", "image/jpeg")
+
+            compare(sectionModel.count, 3)
+            compare(sectionModel.rowForDate(new Date(2021, 3, 30)), 6)
+            compare(sectionModel.sectionForRow(5), 1)
+
+            sectionModel.granularity = CaptureSectionModel.Month
+
+            compare(sectionModel.count, 2)
+            compare(sectionModel.sectionForRow(5), 0)
+            compare(Qt.formatDate(sectionModel.dateForRow(6), "yyyyMMdd"), "20210401")
+
+            captureModel.deleteFile(4)
+
+            tryCompare(captureModel, "count", fileNames1.length)
+            compare(sectionModel.sectionForRow(5), 1)
+        }
+
         function test_append() {
             var i
             var item
@@ -203,6 +302,67 @@ Item {
 
                 compare(item.url, "file:///opt/tests/jolla-camera/auto/" + fileNames1[i])
             }
+
+            captureModel.appendCapture(url, mimeType)
+            captureModel.appendCapture("file:///opt/tests/jolla-camera/auto/captures1/20300000_000001.jpg", mimeType)
+
+            compare(captureModel.count, fileNames1.length + 2)
+
+            captureModel.deleteFiles([0, 1])
+
+            compare(captureModel.count, fileNames1.length)
+            tryCompare(repeater, "count", fileNames1.length)
+
+            item = repeater.itemAt(0)
+            verify(item)
+
+            compare(item.url, "file:///opt/tests/jolla-camera/auto/" + fileNames1[0])
+        }
+
+        function test_paged() {
+            var i
+            var item
+
+            captureModel.pageSize = 3
+            captureModel.directories = [
+                "/opt/tests/jolla-camera/auto/captures1"
+            ]
+
+            tryCompare(captureModel, "count", 3)
+            tryCompare(repeater, "count", 3)
+
+            for (i = 0; i < 3; ++i) {
+                item = repeater.itemAt(i)
+                verify(item)
+
+                compare(item.url, "file:///opt/tests/jolla-camera/auto/" + fileNames1[i])
+            }
+
+            var url = "file:///opt/tests/jolla-camera/auto/captures1/20300000_000000.jpg"
+
+            captureModel.appendCapture(url, "image/jpeg")
+
+            compare(captureModel.count, 4)
+
+            item = repeater.itemAt(0)
+            verify(item)
+            compare(item.url, url)
+
+            captureModel.deleteFile(0)
+
+            tryCompare(captureModel, "count", 3)
+
+            captureModel.pageSize = 0
+
+            tryCompare(captureModel, "count", fileNames1.length)
+            tryCompare(repeater, "count", fileNames1.length)
+
+            for (i = 0; i < fileNames1.length; ++i) {
+                item = repeater.itemAt(i)
+                verify(item)
+
+                compare(item.url, "file:///opt/tests/jolla-camera/auto/" + fileNames1[i])
+            }
         }
     }
 }
@@ -0,0 +1,10 @@
+# SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+#
+# SPDX-License-Identifier: BSD-3-Clause
+
+TEMPLATE = subdirs
+
+SUBDIRS = \
+        capturefilename \
+        capturelist \
+        capturemodel
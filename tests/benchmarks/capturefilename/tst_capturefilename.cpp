@@ -0,0 +1,170 @@
+// SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <QRegularExpression>
+#include <QtTest>
+
+#include <limits>
+
+#include "capturefilename.h"
+
+class tst_CaptureFileName : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void parse_data();
+    void parse();
+    void order();
+
+    void benchmarkParse_data();
+    void benchmarkParse();
+
+private:
+    QVector<QByteArray> m_entries;
+};
+
+void tst_CaptureFileName::initTestCase()
+{
+    // A directory listing as the scan would see it, mostly camera files with the odd file from
+    // another source.
+    for (int i = 0; i < 10000; ++i) {
+        const QDateTime dateTime = QDateTime(QDate(2021, 5, 14), QTime(12, 0)).addSecs(i * 7);
+        QByteArray entry = dateTime.toString(QStringLiteral("yyyyMMdd_HHmmss")).toLatin1();
+        if (i % 10 == 0) {
+            entry += "_001";
+        }
+        switch (i % 20) {
+        case 3:
+            entry = "P" + QByteArray::number(1010000 + i) + ".JPG";
+            break;
+        case 7:
+            entry += ".mp4";
+            break;
+        default:
+            entry += ".jpg";
+            break;
+        }
+        m_entries.append(entry);
+    }
+}
+
+void tst_CaptureFileName::parse_data()
+{
+    QTest::addColumn<QByteArray>("fileName");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("photo") << QByteArray("20210514_152221.jpg") << true;
+    QTest::newRow("video") << QByteArray("20210514_152221.mp4") << true;
+    QTest::newRow("sequence") << QByteArray("20210514_152221_001.jpg") << true;
+    QTest::newRow("long sequence") << QByteArray("20210514_152221_1000.jpg") << true;
+    QTest::newRow("empty sequence") << QByteArray("20210514_152221_.jpg") << false;
+    QTest::newRow("largest sequence") << QByteArray("20210514_152221_8191.jpg") << true;
+    QTest::newRow("sequence overflow") << QByteArray("20210514_152221_8192.jpg") << false;
+    QTest::newRow("hidden") << QByteArray(".20210514_152221.jpg") << false;
+    QTest::newRow("short date") << QByteArray("2021051_152221.jpg") << false;
+    QTest::newRow("no separator") << QByteArray("20210514152221.jpg") << false;
+    QTest::newRow("no dot") << QByteArray("20210514_152221xjpg") << false;
+    QTest::newRow("upper case") << QByteArray("20210514_152221.JPG") << false;
+    QTest::newRow("truncated extension") << QByteArray("20210514_152221.jp") << false;
+    QTest::newRow("trailing characters") << QByteArray("20210514_152221.jpg~") << false;
+    QTest::newRow("other camera") << QByteArray("P1010663.JPG") << false;
+    QTest::newRow("empty") << QByteArray("") << false;
+}
+
+void tst_CaptureFileName::parse()
+{
+    QFETCH(QByteArray, fileName);
+    QFETCH(bool, valid);
+
+    quint64 key = 0;
+    QCOMPARE(parseCaptureFileName(fileName.constData(), &key), valid);
+
+    if (valid) {
+        QCOMPARE(captureFileName(key), fileName);
+    }
+}
+
+void tst_CaptureFileName::order()
+{
+    // Keys sort by date and time and then by the value of the sequence number, so unlike the
+    // descending order of the file names _10 comes before _9.  The same sequence number written
+    // with more digits sorts first, so _01 comes before _1 where the names had _1 first.
+    const QVector<QByteArray> fileNames = {
+        "20210521_091613.jpg",
+        "20210514_152221_8191.jpg",
+        "20210514_152221_10.jpg",
+        "20210514_152221_9.jpg",
+        "20210514_152221_002.jpg",
+        "20210514_152221_001.mp4",
+        "20210514_152221_001.jpg",
+        "20210514_152221_01.jpg",
+        "20210514_152221_1.jpg",
+        "20210514_152221.mp4",
+        "20210514_152221.jpg",
+        "20210514_145420.jpg",
+        "20200101_000000.jpg"
+    };
+
+    quint64 previous = std::numeric_limits<quint64>::max();
+    for (const QByteArray &fileName : fileNames) {
+        quint64 key = 0;
+        QVERIFY(parseCaptureFileName(fileName.constData(), &key));
+        QVERIFY2(key < previous, fileName.constData());
+        previous = key;
+    }
+}
+
+void tst_CaptureFileName::benchmarkParse_data()
+{
+    QTest::addColumn<bool>("regularExpression");
+
+    QTest::newRow("parser, 10000 entries") << false;
+    QTest::newRow("regular expression, 10000 entries") << true;
+}
+
+void tst_CaptureFileName::benchmarkParse()
+{
+    QFETCH(bool, regularExpression);
+
+    int count = 0;
+
+    if (regularExpression) {
+        // The file name filter CaptureModel used previously.
+        static const QRegularExpression cameraFileRegEx = [] {
+            QRegularExpression regex("\\A\\d{8}_\\d{6}(?:_\\d+)?.(?:jpg|mp4)\\z");
+
+            regex.optimize();
+
+            return regex;
+        }();
+
+        QBENCHMARK {
+            count = 0;
+            for (const QByteArray &entry : m_entries) {
+                if (cameraFileRegEx.match(QString::fromUtf8(entry.constData())).hasMatch()) {
+                    ++count;
+                }
+            }
+        }
+    } else {
+        QBENCHMARK {
+            count = 0;
+            for (const QByteArray &entry : m_entries) {
+                quint64 key;
+                if (parseCaptureFileName(entry.constData(), &key)) {
+                    ++count;
+                }
+            }
+        }
+    }
+
+    QCOMPARE(count, m_entries.count() - m_entries.count() / 20);
+}
+
+QTEST_APPLESS_MAIN(tst_CaptureFileName)
+
+#include "tst_capturefilename.moc"
@@ -0,0 +1,19 @@
+# SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+#
+# SPDX-License-Identifier: BSD-3-Clause
+
+TEMPLATE = app
+TARGET = tst_capturelist
+
+QT = core testlib
+CONFIG += c++14
+
+INCLUDEPATH += ../../../src
+
+SOURCES += tst_capturelist.cpp
+
+HEADERS += ../../../src/capturelist.h
+
+target.path = /opt/tests/jolla-camera/benchmarks
+
+INSTALLS += target
@@ -0,0 +1,131 @@
+// SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <QtTest>
+
+#include "capturelist.h"
+
+namespace {
+
+// The same size and layout as a CaptureModel row.
+struct Capture
+{
+    quint64 key;
+    quint16 directory;
+    quint8 mimeType;
+};
+
+}
+
+class tst_CaptureList : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void edits();
+
+    void benchmarkInsert_data();
+    void benchmarkInsert();
+};
+
+void tst_CaptureList::edits()
+{
+    // Apply the same pseudo random edits to a list and a vector and verify they agree.
+    CaptureList<int> list;
+    QVector<int> vector;
+
+    quint32 seed = 1;
+    const auto random = [&seed](int range) {
+        seed = seed * 1103515245 + 12345;
+        return int((seed >> 16) % range);
+    };
+
+    for (int i = 0; i < 20000; ++i) {
+        const int size = vector.count();
+
+        if (size == 0 || random(5) < 3) {
+            const int values[] = { i, i + 1, i + 2 };
+            const int count = 1 + random(3);
+
+            int index;
+            switch (random(3)) {
+            case 0:
+                index = 0;
+                break;
+            case 1:
+                index = size;
+                break;
+            default:
+                index = random(size + 1);
+                break;
+            }
+
+            list.insert(index, values, count);
+            for (int j = count - 1; j >= 0; --j) {
+                vector.insert(index, values[j]);
+            }
+        } else {
+            const int index = random(size);
+            const int count = qMin(size - index, 1 + random(3));
+
+            list.remove(index, count);
+            vector.remove(index, count);
+        }
+
+        QCOMPARE(list.count(), vector.count());
+    }
+
+    QCOMPARE(list.toVector(), vector);
+
+    const CaptureList<int> copy = list;
+    list.removeAt(0);
+    QCOMPARE(copy.toVector(), vector);
+}
+
+void tst_CaptureList::benchmarkInsert_data()
+{
+    QTest::addColumn<bool>("vector");
+    QTest::addColumn<int>("rows");
+
+    for (const int rows : { 1000, 10000, 100000 }) {
+        QTest::newRow(qPrintable(QStringLiteral("list, %1 rows").arg(rows))) << false << rows;
+        QTest::newRow(qPrintable(QStringLiteral("vector, %1 rows").arg(rows))) << true << rows;
+    }
+}
+
+void tst_CaptureList::benchmarkInsert()
+{
+    QFETCH(bool, vector);
+    QFETCH(int, rows);
+
+    // Each iteration inserts a new capture at the front, as taking a photo does, and drops the
+    // oldest so the number of rows stays constant.
+    QVector<Capture> captures;
+    for (int i = 0; i < rows; ++i) {
+        captures.append({ quint64(rows - i), 0, 1 });
+    }
+
+    quint64 key = rows;
+
+    if (vector) {
+        QBENCHMARK {
+            captures.insert(0, { ++key, 0, 1 });
+            captures.removeLast();
+        }
+        QCOMPARE(captures.first().key, key);
+    } else {
+        CaptureList<Capture> list = captures;
+
+        QBENCHMARK {
+            list.insert(0, { ++key, 0, 1 });
+            list.removeAt(list.count() - 1);
+        }
+        QCOMPARE(list.at(0).key, key);
+        QCOMPARE(list.count(), rows);
+    }
+}
+
+QTEST_APPLESS_MAIN(tst_CaptureList)
+
+#include "tst_capturelist.moc"
@@ -0,0 +1,36 @@
+# SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+#
+# SPDX-License-Identifier: BSD-3-Clause
+
+TEMPLATE = app
+TARGET = tst_capturemodel
+
+QT = core gui qml quick testlib
+CONFIG += c++14 link_pkgconfig
+
+PKGCONFIG += mlite5
+
+INCLUDEPATH += ../../../src
+
+SOURCES += \
+        tst_capturemodel.cpp \
+        ../../../src/captureindex.cpp \
+        ../../../src/capturemetadata.cpp \
+        ../../../src/capturemodel.cpp \
+        ../../../src/capturemodelstatistics.cpp \
+        ../../../src/capturethumbnailprovider.cpp \
+        ../../../src/capturetrace.cpp
+
+HEADERS += \
+        ../../../src/capturefilename.h \
+        ../../../src/captureindex.h \
+        ../../../src/capturelist.h \
+        ../../../src/capturemetadata.h \
+        ../../../src/capturemodel.h \
+        ../../../src/capturemodelstatistics.h \
+        ../../../src/capturethumbnailprovider.h \
+        ../../../src/capturetrace.h
+
+target.path = /opt/tests/jolla-camera/benchmarks
+
+INSTALLS += target
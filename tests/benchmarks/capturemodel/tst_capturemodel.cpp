@@ -0,0 +1,340 @@
+// SPDX-FileCopyrightText: 2026 Jolla Mobile Ltd
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <QtTest>
+
+#include "capturemodel.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Measures CaptureModel against synthetic capture directories of 1k, 10k and 100k files.  Run with
+// -csv or -o <file>,xml for results which can be compared between releases.
+
+namespace {
+
+const int burstSize = 100;
+
+QByteArray captureName(const QDateTime &dateTime)
+{
+    return dateTime.toString(QStringLiteral("yyyyMMdd_HHmmss")).toLatin1() + ".jpg";
+}
+
+QByteArray capturePath(const QString &directory, const QDateTime &dateTime)
+{
+    return QFile::encodeName(directory) + '/' + captureName(dateTime);
+}
+
+// Creates empty camera files taken interval seconds apart, the model only looks at the names.
+bool createFiles(const QString &directory, const QDateTime &start, int interval, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const int fd = open(
+                    capturePath(directory, start.addSecs(qint64(i) * interval)).constData(),
+                    O_WRONLY | O_CREAT | O_CLOEXEC,
+                    0644);
+        if (fd < 0) {
+            return false;
+        }
+        close(fd);
+    }
+    return true;
+}
+
+void removeIndexes()
+{
+    QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                + QLatin1String("/captures")).removeRecursively();
+}
+
+// Runs the event loop until the condition holds, without the polling interval of QTRY_VERIFY
+// adding to the measured time.
+template <typename Condition> bool waitFor(CaptureModel *model, const Condition &condition)
+{
+    if (condition()) {
+        return true;
+    }
+
+    QEventLoop loop;
+    const auto check = [&]() {
+        if (condition()) {
+            loop.quit();
+        }
+    };
+    QObject::connect(model, &CaptureModel::countChanged, &loop, check);
+    QObject::connect(model, &CaptureModel::populatedChanged, &loop, check);
+    QTimer::singleShot(120000, &loop, &QEventLoop::quit);
+
+    loop.exec();
+
+    return condition();
+}
+
+// Populates the model from the directories without an index, so the model is idle once it is
+// populated.
+bool populate(CaptureModel *model, const QStringList &directories, int count)
+{
+    removeIndexes();
+
+    model->setDirectories(directories);
+
+    return waitFor(model, [model, count]() {
+        return model->isPopulated() && model->rowCount() == count;
+    });
+}
+
+qint64 peakResidentSize()
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (status.open(QIODevice::ReadOnly)) {
+        for (QByteArray line; !(line = status.readLine()).isEmpty();) {
+            if (line.startsWith("VmHWM:")) {
+                return line.mid(6).trimmed().split(' ').value(0).toLongLong() * 1024;
+            }
+        }
+    }
+    return 0;
+}
+
+void resetPeakResidentSize()
+{
+    // Supported since Linux 4.0, on older kernels the peak is for the lifetime of the process.
+    QFile clearRefs(QStringLiteral("/proc/self/clear_refs"));
+    if (clearRefs.open(QIODevice::WriteOnly)) {
+        clearRefs.write("5");
+    }
+}
+
+}
+
+class tst_CaptureModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void benchmarkPopulate_data();
+    void benchmarkPopulate();
+    void benchmarkAppend_data();
+    void benchmarkAppend();
+    void benchmarkRescan_data();
+    void benchmarkRescan();
+    void benchmarkBurst_data();
+    void benchmarkBurst();
+    void benchmarkPeakMemory_data();
+    void benchmarkPeakMemory();
+
+private:
+    static void addFileRows();
+
+    QString directoryPath(int files) const;
+    QString rescanDirectoryPath(int files) const;
+
+    QTemporaryDir m_directory;
+};
+
+void tst_CaptureModel::initTestCase()
+{
+    // Keep the directory indexes away from those of the camera.
+    QStandardPaths::setTestModeEnabled(true);
+
+    QVERIFY(m_directory.isValid());
+
+    const QDateTime start(QDate(2021, 5, 14), QTime(12, 0));
+
+    for (const int files : { 1000, 10000, 100000 }) {
+        QVERIFY(QDir().mkpath(directoryPath(files)));
+        QVERIFY(createFiles(directoryPath(files), start, 7, files));
+
+        // A directory with a capture for every hundred in the first, interleaved with them.
+        QVERIFY(QDir().mkpath(rescanDirectoryPath(files)));
+        QVERIFY(createFiles(rescanDirectoryPath(files), start.addSecs(3), 700, files / 100));
+    }
+}
+
+void tst_CaptureModel::addFileRows()
+{
+    QTest::addColumn<int>("files");
+
+    for (const int files : { 1000, 10000, 100000 }) {
+        QTest::newRow(qPrintable(QStringLiteral("%1 files").arg(files))) << files;
+    }
+}
+
+QString tst_CaptureModel::directoryPath(int files) const
+{
+    return QFileInfo(m_directory.path()).canonicalFilePath() + QLatin1Char('/') + QString::number(files);
+}
+
+QString tst_CaptureModel::rescanDirectoryPath(int files) const
+{
+    return directoryPath(files) + QLatin1String("-rescan");
+}
+
+void tst_CaptureModel::benchmarkPopulate_data()
+{
+    QTest::addColumn<int>("files");
+    QTest::addColumn<bool>("indexed");
+    QTest::addColumn<int>("pageSize");
+
+    for (const int files : { 1000, 10000, 100000 }) {
+        QTest::newRow(qPrintable(QStringLiteral("scan, %1 files").arg(files))) << files << false << 0;
+        QTest::newRow(qPrintable(QStringLiteral("index, %1 files").arg(files))) << files << true << 0;
+        QTest::newRow(qPrintable(QStringLiteral("paged scan, %1 files").arg(files))) << files << false << 60;
+    }
+}
+
+void tst_CaptureModel::benchmarkPopulate()
+{
+    QFETCH(int, files);
+    QFETCH(bool, indexed);
+    QFETCH(int, pageSize);
+
+    const QStringList directories = { directoryPath(files) };
+
+    if (indexed) {
+        CaptureModel model;
+        QVERIFY(populate(&model, directories, files));
+    }
+
+    const int rows = pageSize > 0 ? qMin(pageSize, files) : files;
+
+    // The time until the first rows can be shown.
+    QBENCHMARK {
+        if (!indexed) {
+            removeIndexes();
+        }
+
+        CaptureModel model;
+        model.setPageSize(pageSize);
+        model.setDirectories(directories);
+
+        QVERIFY(waitFor(&model, [&model, rows]() {
+            return model.isPopulated() && model.rowCount() == rows;
+        }));
+    }
+}
+
+void tst_CaptureModel::benchmarkAppend_data()
+{
+    addFileRows();
+}
+
+void tst_CaptureModel::benchmarkAppend()
+{
+    QFETCH(int, files);
+
+    const QString directory = directoryPath(files);
+
+    CaptureModel model;
+    QVERIFY(populate(&model, { directory }, files));
+
+    // The latency of adding a new capture as the camera does after taking a photo.
+    const QDateTime start(QDate(2030, 1, 1), QTime(0, 0));
+    int appended = 0;
+
+    QBENCHMARK {
+        model.appendCapture(
+                    QUrl::fromLocalFile(QFile::decodeName(capturePath(directory, start.addSecs(appended)))),
+                    QStringLiteral("image/jpeg"));
+        ++appended;
+    }
+
+    QCOMPARE(model.rowCount(), files + appended);
+}
+
+void tst_CaptureModel::benchmarkRescan_data()
+{
+    addFileRows();
+}
+
+void tst_CaptureModel::benchmarkRescan()
+{
+    QFETCH(int, files);
+
+    const QString directory = directoryPath(files);
+    const QString rescanDirectory = rescanDirectoryPath(files);
+    const int rescanFiles = files / 100;
+
+    CaptureModel model;
+    QVERIFY(populate(&model, { directory }, files));
+
+    // Adding and removing a small directory whose captures are interleaved with those already in
+    // the model diffs the whole model against a partial rescan.
+    QBENCHMARK {
+        model.setDirectories({ directory, rescanDirectory });
+        QVERIFY(waitFor(&model, [&model, files, rescanFiles]() {
+            return model.rowCount() == files + rescanFiles;
+        }));
+
+        model.setDirectories({ directory });
+        QVERIFY(waitFor(&model, [&model, files]() {
+            return model.rowCount() == files;
+        }));
+    }
+}
+
+void tst_CaptureModel::benchmarkBurst_data()
+{
+    addFileRows();
+}
+
+void tst_CaptureModel::benchmarkBurst()
+{
+    QFETCH(int, files);
+
+    const QString directory = directoryPath(files);
+
+    CaptureModel model;
+    QVERIFY(populate(&model, { directory }, files));
+
+    // The time for a burst of new files to be reported by inotify and applied to the model, and
+    // then for their removal.  This includes the batch interval.
+    QDateTime start(QDate(2030, 1, 1), QTime(0, 0));
+
+    QBENCHMARK {
+        QVERIFY(createFiles(directory, start, 1, burstSize));
+        QVERIFY(waitFor(&model, [&model, files]() {
+            return model.rowCount() == files + burstSize;
+        }));
+
+        for (int i = 0; i < burstSize; ++i) {
+            unlink(capturePath(directory, start.addSecs(i)).constData());
+        }
+        QVERIFY(waitFor(&model, [&model, files]() {
+            return model.rowCount() == files;
+        }));
+
+        start = start.addSecs(burstSize);
+    }
+}
+
+void tst_CaptureModel::benchmarkPeakMemory_data()
+{
+    addFileRows();
+}
+
+void tst_CaptureModel::benchmarkPeakMemory()
+{
+    QFETCH(int, files);
+
+    resetPeakResidentSize();
+
+    qint64 peak = 0;
+    {
+        CaptureModel model;
+        QVERIFY(populate(&model, { directoryPath(files) }, files));
+
+        peak = peakResidentSize();
+    }
+
+    QVERIFY(peak > 0);
+
+    QTest::setBenchmarkResult(peak, QTest::BytesAllocated);
+}
+
+QTEST_GUILESS_MAIN(tst_CaptureModel)
+
+#include "tst_capturemodel.moc"
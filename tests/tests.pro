@@ -1,10 +1,12 @@
 # SPDX-FileCopyrightText: 2013 - 2014 Jolla Ltd.
-# SPDX-FileCopyrightText: 2025 Jolla Mobile Ltd
+# SPDX-FileCopyrightText: 2025 - 2026 Jolla Mobile Ltd
 #
 # SPDX-License-Identifier: BSD-3-Clause
 
 TEMPLATE = subdirs
 
+SUBDIRS = benchmarks
+
 OTHER_FILES += auto/*
 
 auto.files = auto/*